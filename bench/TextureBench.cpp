@@ -0,0 +1,85 @@
+/// Compares bilinear sampling throughput of the Linear and Tiled texture
+/// layouts, for a full screen quad textured at several rotations.
+///
+/// Usage: trender_texbench [texture size] [screen size]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+#include "../src/data/TTexture.h"
+
+static TTexture* makeTexture(int size, TTextureFormat format) {
+	TTexture* tex = new TTexture(size, size, format);
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			float r = float((x * 7 + y * 13) & 255) / 255.0f;
+			float g = float((x ^ y) & 255) / 255.0f;
+			tex->set(x, y, glm::vec4(r, g, 0.5f, 1.0f));
+		}
+	}
+	return tex;
+}
+
+/// Samples a rotated quad covering screen x screen pixels, returns Msamples/s
+static double benchQuad(const TTexture& tex, int screen, float angle, glm::vec4& sink) {
+	const float c = std::cos(angle), s = std::sin(angle);
+	const float inv = 1.0f / float(screen);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	glm::vec4 sum(0.0f);
+	for (int y = 0; y < screen; y++) {
+		for (int x = 0; x < screen; x++) {
+			/// Rotate around the center of the texture
+			float px = float(x) * inv - 0.5f;
+			float py = float(y) * inv - 0.5f;
+			float u = c * px - s * py + 0.5f;
+			float v = s * px + c * py + 0.5f;
+			sum += tex.getBilinear(u - std::floor(u), v - std::floor(v));
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	sink += sum;
+	return double(screen) * screen / seconds / 1e6;
+}
+
+int main(int argc, char** argv) {
+	const int size = argc > 1 ? std::atoi(argv[1]) : 4096;
+	const int screen = argc > 2 ? std::atoi(argv[2]) : size;
+	const float angles[] = { 0.0f, 30.0f, 45.0f, 90.0f };
+	const TTextureFormat formats[] = { TTextureFormat::RGBA8, TTextureFormat::RGBA32F };
+	const char* formatNames[] = { "RGBA8", "RGBA32F" };
+
+	glm::vec4 sink(0.0f);
+
+	std::cout << "texture " << size << "x" << size << ", quad " << screen << "x" << screen << " pixels" << std::endl;
+	std::cout << std::setw(8) << "format" << std::setw(8) << "angle" <<
+		std::setw(14) << "linear MS/s" << std::setw(14) << "tiled MS/s" << std::setw(10) << "speedup" << std::endl;
+
+	for (int f = 0; f < 2; f++) {
+		TTexture* linear = makeTexture(size, formats[f]);
+		TTexture* tiled = makeTexture(size, formats[f]);
+		tiled->layout(TTextureLayout::Tiled);
+
+		for (float angle : angles) {
+			const float rad = angle * 3.14159265f / 180.0f;
+			double lin = 0.0, til = 0.0;
+			for (int run = 0; run < 5; run++) {
+				lin = std::max(lin, benchQuad(*linear, screen, rad, sink));
+				til = std::max(til, benchQuad(*tiled, screen, rad, sink));
+			}
+			std::cout << std::setw(8) << formatNames[f] << std::setw(8) << std::setprecision(0) << angle <<
+				std::fixed << std::setprecision(1) <<
+				std::setw(14) << lin << std::setw(14) << til <<
+				std::setprecision(2) << std::setw(9) << (til / lin) << "x" << std::endl;
+		}
+
+		delete linear;
+		delete tiled;
+	}
+
+	std::cerr << "(checksum " << sink.x + sink.y << ")" << std::endl;
+	return 0;
+}
@@ -1,9 +1,16 @@
 #include "TFrameBuffer.h"
 
+#include <algorithm>
+
 TFrameBuffer::TFrameBuffer(int w, int h) {
 	m_texture = new TTexture(w, h);
 	m_depthBuffer.resize(w * h);
 	std::fill(m_depthBuffer.begin(), m_depthBuffer.end(), 0.0f);
+
+	m_hiZWidth = (w + T_HIZ_BLOCK - 1) / T_HIZ_BLOCK;
+	m_hiZHeight = (h + T_HIZ_BLOCK - 1) / T_HIZ_BLOCK;
+	m_hiZ.assign(m_hiZWidth * m_hiZHeight, 0.0f);
+	m_hiZDirty.assign(m_hiZWidth * m_hiZHeight, 0);
 }
 
 float TFrameBuffer::depth(int x, int y) const {
@@ -18,6 +25,32 @@ void TFrameBuffer::depth(int x, int y, float d) {
 		return;
 	}
 	m_depthBuffer[x + y * width()] = d;
+	invalidateHiZ(x, y);
+}
+
+void TFrameBuffer::updateHiZ(int bx, int by) {
+	const int x0 = bx * T_HIZ_BLOCK, x1 = std::min(x0 + T_HIZ_BLOCK, width());
+	const int y0 = by * T_HIZ_BLOCK, y1 = std::min(y0 + T_HIZ_BLOCK, height());
+
+	float farthest = m_depthBuffer[x0 + y0 * width()];
+	for (int y = y0; y < y1; y++) {
+		const float* row = &m_depthBuffer[y * width()];
+		for (int x = x0; x < x1; x++) {
+			farthest = std::min(farthest, row[x]);
+		}
+	}
+
+	const int i = bx + by * m_hiZWidth;
+	m_hiZ[i] = farthest;
+	m_hiZDirty[i] = 0;
+}
+
+void TFrameBuffer::refreshHiZ(int by) {
+	for (int bx = 0; bx < m_hiZWidth; bx++) {
+		if (m_hiZDirty[bx + by * m_hiZWidth]) {
+			updateHiZ(bx, by);
+		}
+	}
 }
 
 TFrameBuffer::~TFrameBuffer() {
@@ -26,5 +59,7 @@ TFrameBuffer::~TFrameBuffer() {
 
 void TFrameBuffer::clear(const glm::vec4& color) {
 	std::fill(m_depthBuffer.begin(), m_depthBuffer.end(), 0.0f);
+	std::fill(m_hiZ.begin(), m_hiZ.end(), 0.0f);
+	std::fill(m_hiZDirty.begin(), m_hiZDirty.end(), 0);
 	m_texture->clear(color);
 }
\ No newline at end of file
@@ -3,11 +3,35 @@
 
 #include "TTexture.h"
 
+/// Side, in pixels, of the hierarchical Z blocks
+#define T_HIZ_BLOCK 8
+
 class TFrameBuffer {
 	friend class GFX;
 public:
 	float depth(int x, int y) const;
 	void depth(int x, int y, float d);
+	float* depthRow(int y) { return &m_depthBuffer[y * width()]; }
+
+	/// Hierarchical Z: per T_HIZ_BLOCK square block, the farthest stored depth,
+	/// so nothing at or behind it can pass the depth test there. Writes through
+	/// depthRow() must call invalidateHiZ(), stale blocks are recomputed when
+	/// read. A block is only safe to read from the thread that writes it.
+	float hiZ(int bx, int by) {
+		const int i = bx + by * m_hiZWidth;
+		if (m_hiZDirty[i]) {
+			updateHiZ(bx, by);
+		}
+		return m_hiZ[i];
+	}
+	void invalidateHiZ(int x, int y) { m_hiZDirty[x / T_HIZ_BLOCK + (y / T_HIZ_BLOCK) * m_hiZWidth] = 1; }
+
+	/// Recomputes the stale blocks of block row 'by'. Once every row is
+	/// refreshed hiZ() is read-only until the next write.
+	void refreshHiZ(int by);
+
+	int hiZWidth() const { return m_hiZWidth; }
+	int hiZHeight() const { return m_hiZHeight; }
 
 	TTexture* texture() { return m_texture; }
 
@@ -22,6 +46,12 @@ public:
 private:
 	std::vector<float> m_depthBuffer;
 	TTexture* m_texture;
+
+	std::vector<float> m_hiZ;
+	std::vector<uint8_t> m_hiZDirty;
+	int m_hiZWidth, m_hiZHeight;
+
+	void updateHiZ(int bx, int by);
 };
 
 #endif // T_FRAMEBUFFER_H
\ No newline at end of file
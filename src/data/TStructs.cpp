@@ -1,5 +1,7 @@
 #include "TStructs.h"
 
+#include <cmath>
+
 TVertex TVertex::transform(const glm::mat4& mvp) const {
 	TVertex tvx;
 	tvx.normal = glm::normalize(glm::vec3(mvp * glm::vec4(normal, 0.0f)));
@@ -9,7 +11,7 @@ TVertex TVertex::transform(const glm::mat4& mvp) const {
 	return tvx;
 }
 
-TVertex TVertex::lerp(const TVertex& other, float amt) {
+TVertex TVertex::lerp(const TVertex& other, float amt) const {
 	TVertex tvx;
 	tvx.normal = glm::mix(normal, other.normal, amt);
 	tvx.position = glm::mix(position, other.position, amt);
@@ -18,6 +20,79 @@ TVertex TVertex::lerp(const TVertex& other, float amt) {
 	return tvx;
 }
 
+/// Rounds towards negative infinity, unlike the integer division
+static int64_t floorDiv(int64_t a, int64_t b) {
+	int64_t q = a / b;
+	return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+bool TTriangle::setup(const glm::ivec2& p0, const glm::ivec2& p1, const glm::ivec2& p2) {
+	const int64_t area = int64_t(p1.x - p0.x) * (p2.y - p0.y) - int64_t(p1.y - p0.y) * (p2.x - p0.x);
+	if (area == 0) {
+		return false;
+	}
+
+	const int64_t one = int64_t(1) << T_SUBPIXEL_BITS;
+	const int64_t half = one >> 1;
+	const glm::ivec2* p[] = { &p0, &p1, &p2 };
+	const double invArea = 1.0 / double(area);
+
+	for (int i = 0; i < 3; i++) {
+		/// Edge opposite of vertex i, from j to k
+		const glm::ivec2& pj = *p[(i + 1) % 3];
+		const glm::ivec2& pk = *p[(i + 2) % 3];
+
+		/// E(P) = (k - j) x (P - j) with P at the center of pixel (0, 0), it
+		/// grows by 'a' and 'b' sub-pixel units per pixel in x and y
+		int64_t a = -int64_t(pk.y - pj.y);
+		int64_t b = int64_t(pk.x - pj.x);
+		int64_t c = b * (half - pj.y) + a * (half - pj.x);
+
+		/// Barycentric weights, the area has the same sign as every E inside
+		edgeA[i] = float(double(a * one) * invArea);
+		edgeB[i] = float(double(b * one) * invArea);
+		edgeC[i] = float(double(c) * invArea);
+
+		if (area < 0) {
+			a = -a;
+			b = -b;
+			c = -c;
+		}
+
+		/// Top-left rule: pixels exactly on an edge belong to it only if it's a
+		/// left edge, or a top edge (horizontal with the inside below). Any
+		/// shared edge is owned by exactly one of its two triangles.
+		const bool topLeft = a > 0 || (a == 0 && b > 0);
+		if (!topLeft) {
+			c -= 1;
+		}
+
+		/// Whole pixel steps are multiples of 'one', so E >= 0 can be tested
+		/// exactly with everything divided by it
+		fixedA[i] = int32_t(a);
+		fixedB[i] = int32_t(b);
+		fixedC[i] = floorDiv(c, one);
+	}
+	return true;
+}
+
+TCoverage TTriangle::coverage(int x0, int y0, int x1, int y1) const {
+	bool full = true;
+	for (int i = 0; i < 3; i++) {
+		/// An edge function is linear, its extremes over the rectangle are at
+		/// the corners picked by the signs of its gradient
+		const int64_t eMax = int64_t(fixedA[i]) * (fixedA[i] > 0 ? x1 : x0) + int64_t(fixedB[i]) * (fixedB[i] > 0 ? y1 : y0) + fixedC[i];
+		if (eMax < 0) {
+			return TCoverage::None;
+		}
+		const int64_t eMin = int64_t(fixedA[i]) * (fixedA[i] > 0 ? x0 : x1) + int64_t(fixedB[i]) * (fixedB[i] > 0 ? y0 : y1) + fixedC[i];
+		if (eMin < 0) {
+			full = false;
+		}
+	}
+	return full ? TCoverage::Full : TCoverage::Partial;
+}
+
 bool TAABB::overlaps(const TAABB& other) {
 	if (other.minX > maxX || other.maxX < minX)
 		return false;
@@ -8,6 +8,10 @@
 #include "TTexture.h"
 
 #include <array>
+#include <cstdint>
+
+/// Fractional bits of the fixed-point screen positions used for coverage
+#define T_SUBPIXEL_BITS 8
 
 struct TVertex {
 	glm::vec4 position;
@@ -16,13 +20,43 @@ struct TVertex {
 	glm::vec4 color;
 
 	TVertex transform(const glm::mat4& mvp) const;
-	TVertex lerp(const TVertex& other, float amt);
+	TVertex lerp(const TVertex& other, float amt) const;
+};
+
+enum class TCoverage {
+	None, // No pixel center passes the coverage test
+	Partial, // Some may pass
+	Full // All pass
 };
 
 struct TTriangle {
 	TVertex v0, v1, v2;
 	glm::vec4 vp0, vp1, vp2;
+
+	/// Edge functions, pre-divided by the signed area, so that the barycentric
+	/// weight of vertex i at the center of pixel (x, y) is
+	/// edgeA[i] * x + edgeB[i] * y + edgeC[i]. Used for interpolation only.
+	glm::vec3 edgeA, edgeB, edgeC;
+
+	/// Fixed-point edge functions, they decide coverage: pixel (x, y) is
+	/// covered when fixedA[i] * x + fixedB[i] * y + fixedC[i] >= 0 for every
+	/// i. Oriented positive inside, with the top-left fill rule folded into C.
+	int32_t fixedA[3], fixedB[3];
+	int64_t fixedC[3];
+
 	int minX, minY, maxX, maxY;
+
+	/// Upper bound of the depth the triangle can write, for hierarchical Z
+	float maxZ;
+
+	int draw; // Index of the draw command the triangle came from
+
+	/// Sets up both sets of edge functions from the vertex positions snapped
+	/// to T_SUBPIXEL_BITS. Returns false for zero-area triangles.
+	bool setup(const glm::ivec2& p0, const glm::ivec2& p1, const glm::ivec2& p2);
+
+	/// Exact coverage of the pixels in [x0, x1] x [y0, y1]
+	TCoverage coverage(int x0, int y0, int x1, int y1) const;
 };
 
 struct TAABB {
@@ -36,34 +70,53 @@ struct TAABB {
 	bool overlaps(const TAABB& other);
 };
 
+/// Most pixels handed to TShader::pixels() at once
+#define T_PIXEL_BATCH 8
+
 struct TPixelInput {
 	glm::vec4 vertexPositions;
 	glm::vec4 vertexColors;
 	glm::vec3 normals;
 	glm::vec2 texCoords;
+	glm::vec2 texCoordsDx, texCoordsDy; // Screen-space derivatives, per 2x2 quad
 	TTexture* boundTexture;
+
+	mutable bool discarded; // Set by TShader::discard(), one per invocation
 };
 
 class TShader {
 	friend class GFX;
 public:
-	virtual TVertex vertex(glm::mat4 projection, glm::mat4 viewModel, TVertex vertex) = 0;
-	virtual glm::vec4 pixel(TPixelInput input) = 0;
+	virtual TVertex vertex(const glm::mat4& projection, const glm::mat4& viewModel, const TVertex& vertex) = 0;
+	virtual glm::vec4 pixel(const TPixelInput& input) = 0;
+
+	/// Shades 'count' (<= T_PIXEL_BATCH) pixels of one triangle at once. Bit i
+	/// of 'mask' is set for every live lane, clearing it discards the pixel.
+	/// The default runs pixel() on each live lane.
+	virtual void pixels(const TPixelInput* inputs, glm::vec4* colors, int count, uint32_t& mask) {
+		for (int i = 0; i < count; i++) {
+			if (mask & (1u << i)) {
+				colors[i] = pixel(inputs[i]);
+				if (inputs[i].discarded) {
+					mask &= ~(1u << i);
+				}
+			}
+		}
+	}
 
-	glm::vec4 discard() { m_discard = true; return glm::vec4(0.0f); }
-protected:
-	bool m_discard;
+	/// Discards the pixel 'input' belongs to, return it from pixel()
+	glm::vec4 discard(const TPixelInput& input) { input.discarded = true; return glm::vec4(0.0f); }
 };
 
 class DefaultShader : public TShader {
 public:
-	TVertex vertex(glm::mat4 projection, glm::mat4 viewModel, TVertex in) override {
+	TVertex vertex(const glm::mat4& projection, const glm::mat4& viewModel, const TVertex& in) override {
 		return in.transform(projection * viewModel);
 	}
 
-	glm::vec4 pixel(TPixelInput in) override {
+	glm::vec4 pixel(const TPixelInput& in) override {
 		glm::vec4 texCol = in.boundTexture != nullptr ?
-						in.boundTexture->getBilinear(in.texCoords.x, in.texCoords.y) :
+						in.boundTexture->sample(in.texCoords, in.texCoordsDx, in.texCoordsDy) :
 						glm::vec4(1.0f);
 		return texCol;
 	}
@@ -1,25 +1,24 @@
 #include "TTexture.h"
 
 #include <algorithm>
+#include <cstring>
+#include <cmath>
 
-TTexture::TTexture(int w, int h) {
-	m_width = w;
-	m_height = h;
-	m_size = std::max(m_width, m_height);
-	m_pixels.resize(m_size * m_size);
-	std::fill(m_pixels.begin(), m_pixels.end(), glm::vec4(0.0f, 0.0f, 0.0f, 0.0f));
+#include "packing.hpp"
+
+TTexture::TTexture(int w, int h, TTextureFormat format) {
+	allocate(w, h, format);
+	clear(glm::vec4(0.0f, 0.0f, 0.0f, 0.0f));
 }
 
-TTexture::TTexture(const std::string& fileName) {
-	int w, h, comp;
-	stbi_uc* pixels = stbi_load(fileName.c_str(), &w, &h, &comp, STBI_rgb);
+TTexture::TTexture(const std::string& fileName, TTextureFormat format, bool mipmaps) {
+	const int comp = format == TTextureFormat::R8 ? STBI_grey : STBI_rgb_alpha;
+
+	int w, h, fileComp;
+	stbi_uc* pixels = stbi_load(fileName.c_str(), &w, &h, &fileComp, comp);
 	if (pixels) {
-		m_width = w;
-		m_height = h;
-		m_size = std::max(m_width, m_height);
-		m_pixels.resize(m_size * m_size);
-		std::fill(m_pixels.begin(), m_pixels.end(), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-		
+		allocate(w, h, format);
+
 		for (int y = 0; y < m_height; y++) {
 			for (int x = 0; x < m_width; x++) {
 				int i = (x + (m_height - 1 - y) * m_width) * comp;
@@ -27,11 +26,17 @@ TTexture::TTexture(const std::string& fileName) {
 				for (int k = 0; k < comp; k++) {
 					col[k] = pixels[i + k] / 255.0f;
 				}
-				set(x, y, col);
+				store(texelIndex(x, y, m_levels[0]), col);
 			}
 		}
 		stbi_image_free(pixels);
+
+		if (mipmaps) {
+			generateMipmaps();
+		}
 	} else {
+		m_format = format;
+		m_layout = TTextureLayout::Linear;
 		m_width = 0;
 		m_height = 0;
 	}
@@ -61,12 +66,179 @@ uint32_t TTexture::calcZOrder(uint16_t xPos, uint16_t yPos) {
 	return result;
 }
 
-glm::vec4 TTexture::get(int x, int y) const {
-	if (x < 0 || x >= m_width || y < 0 || y >= m_height) {
+int TTexture::bytesPerTexel(TTextureFormat format) {
+	switch (format) {
+		case TTextureFormat::RGBA32F: return sizeof(glm::vec4);
+		case TTextureFormat::RGBA8: return 4;
+		case TTextureFormat::R8: return 1;
+		case TTextureFormat::RG16F: return 4;
+	}
+	return 0;
+}
+
+void TTexture::allocate(int w, int h, TTextureFormat format) {
+	m_width = w;
+	m_height = h;
+	m_format = format;
+	m_layout = TTextureLayout::Linear;
+
+	/// Square blocks of 64 bytes: 8x8 (R8), 4x4 (RGBA8, RG16F), 2x2 (RGBA32F)
+	switch (bytesPerTexel(format)) {
+		case 1: m_blockShift = 3; break;
+		case 4: m_blockShift = 2; break;
+		default: m_blockShift = 1; break;
+	}
+
+	buildLevels(1);
+}
+
+void TTexture::resizeStorage(size_t texels) {
+	if (m_format == TTextureFormat::RGBA32F) {
+		m_pixels.resize(texels);
+	} else {
+		m_data.resize(texels * bytesPerTexel(m_format));
+	}
+}
+
+/// Lays out 'count' levels (0 = the full chain) for the current layout
+void TTexture::buildLevels(int count) {
+	m_levels.clear();
+
+	const int block = 1 << m_blockShift;
+	int w = m_width, h = m_height;
+	size_t texels = 0;
+	while (true) {
+		TMipLevel lvl;
+		lvl.width = w;
+		lvl.height = h;
+		lvl.offset = texels;
+		if (m_layout == TTextureLayout::Linear) {
+			lvl.stride = w;
+			texels += size_t(w) * h;
+		} else {
+			lvl.stride = (w + block - 1) >> m_blockShift;
+			texels += size_t(lvl.stride) * ((h + block - 1) >> m_blockShift) * block * block;
+		}
+		m_levels.push_back(lvl);
+
+		if (int(m_levels.size()) == count || (w == 1 && h == 1)) {
+			break;
+		}
+		w = std::max(1, w / 2);
+		h = std::max(1, h / 2);
+	}
+	resizeStorage(texels);
+}
+
+void TTexture::generateMipmaps() {
+	buildLevels(0);
+
+	for (int l = 1; l < levels(); l++) {
+		const TMipLevel& src = m_levels[l - 1];
+		const TMipLevel& dst = m_levels[l];
+
+		#pragma omp parallel for schedule(static)
+		for (int y = 0; y < dst.height; y++) {
+			const int y0 = std::min(y * 2, src.height - 1);
+			const int y1 = std::min(y * 2 + 1, src.height - 1);
+			for (int x = 0; x < dst.width; x++) {
+				const int x0 = std::min(x * 2, src.width - 1);
+				const int x1 = std::min(x * 2 + 1, src.width - 1);
+				glm::vec4 sum = fetch(texelIndex(x0, y0, src)) +
+								fetch(texelIndex(x1, y0, src)) +
+								fetch(texelIndex(x0, y1, src)) +
+								fetch(texelIndex(x1, y1, src));
+				store(texelIndex(x, y, dst), sum * 0.25f);
+			}
+		}
+	}
+}
+
+void TTexture::layout(TTextureLayout layout) {
+	if (layout == m_layout || !valid()) {
+		m_layout = layout;
+		return;
+	}
+
+	TTexture old = *this;
+
+	m_layout = layout;
+	m_pixels.clear();
+	m_data.clear();
+	buildLevels(old.levels());
+
+	for (int l = 0; l < levels(); l++) {
+		const TMipLevel& src = old.m_levels[l];
+		const TMipLevel& dst = m_levels[l];
+
+		#pragma omp parallel for schedule(static)
+		for (int y = 0; y < dst.height; y++) {
+			for (int x = 0; x < dst.width; x++) {
+				store(texelIndex(x, y, dst), old.fetch(old.texelIndex(x, y, src)));
+			}
+		}
+	}
+}
+
+glm::vec4 TTexture::fetch(int index) const {
+	switch (m_format) {
+		case TTextureFormat::RGBA32F:
+			return m_pixels[index];
+		case TTextureFormat::RGBA8: {
+			const uint8_t* t = &m_data[index * 4];
+			return glm::vec4(t[0], t[1], t[2], t[3]) * (1.0f / 255.0f);
+		}
+		case TTextureFormat::R8:
+			return glm::vec4(m_data[index] * (1.0f / 255.0f), 0.0f, 0.0f, 1.0f);
+		case TTextureFormat::RG16F: {
+			uint32_t packed;
+			std::memcpy(&packed, &m_data[index * 4], 4);
+			return glm::vec4(glm::unpackHalf2x16(packed), 0.0f, 1.0f);
+		}
+	}
+	return glm::vec4(0.0f);
+}
+
+void TTexture::store(int index, const glm::vec4& color) {
+	switch (m_format) {
+		case TTextureFormat::RGBA32F:
+			m_pixels[index] = color;
+			break;
+		case TTextureFormat::RGBA8: {
+			glm::vec4 c = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+			uint8_t* t = &m_data[index * 4];
+			t[0] = uint8_t(c.r);
+			t[1] = uint8_t(c.g);
+			t[2] = uint8_t(c.b);
+			t[3] = uint8_t(c.a);
+		} break;
+		case TTextureFormat::R8:
+			m_data[index] = uint8_t(glm::clamp(color.r, 0.0f, 1.0f) * 255.0f + 0.5f);
+			break;
+		case TTextureFormat::RG16F: {
+			uint32_t packed = glm::packHalf2x16(glm::vec2(color.r, color.g));
+			std::memcpy(&m_data[index * 4], &packed, 4);
+		} break;
+	}
+}
+
+glm::vec4 TTexture::get(int x, int y, int level) const {
+	const TMipLevel& lvl = m_levels[level];
+	if (x < 0 || x >= lvl.width || y < 0 || y >= lvl.height) {
 		return glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
 	}
-	// return m_pixels[calcZOrder(x, y)];
-	return m_pixels[x+y*m_width];
+	return fetch(texelIndex(x, y, lvl));
+}
+
+const glm::vec4* TTexture::row(int y, glm::vec4* scratch) const {
+	const TMipLevel& lvl = m_levels[0];
+	if (m_layout == TTextureLayout::Linear) {
+		return &m_pixels[texelIndex(0, y, lvl)];
+	}
+	for (int x = 0; x < m_width; x++) {
+		scratch[x] = m_pixels[texelIndex(x, y, lvl)];
+	}
+	return scratch;
 }
 
 glm::vec4 TTexture::get(float s, float t) const {
@@ -77,9 +249,10 @@ glm::vec4 TTexture::get(float s, float t) const {
 	return get(x, y);
 }
 
-glm::vec4 TTexture::getBilinear(float s, float t) const {
-	s = s * (float(m_width) - 0.5f);
-	t = t * (float(m_height) - 0.5f);
+glm::vec4 TTexture::getBilinear(float s, float t, int level) const {
+	const TMipLevel& lvl = m_levels[level];
+	s = s * (float(lvl.width) - 0.5f);
+	t = t * (float(lvl.height) - 0.5f);
 	int x = floor(s);
 	int y = floor(t);
 
@@ -88,23 +261,50 @@ glm::vec4 TTexture::getBilinear(float s, float t) const {
 	float s_opposite = 1.0f - s_ratio;
 	float t_opposite = 1.0f - t_ratio;
 
-	glm::vec4 res = (get(x, y) * s_opposite + get(x+1, y) * s_ratio) * t_opposite + 
-					(get(x, y+1) * s_opposite + get(x+1, y+1) * s_ratio) * t_ratio;
+	/// Clamp to the edge, small mip levels would otherwise blend with black
+	int x0 = glm::clamp(x, 0, lvl.width - 1), x1 = glm::clamp(x + 1, 0, lvl.width - 1);
+	int y0 = glm::clamp(y, 0, lvl.height - 1), y1 = glm::clamp(y + 1, 0, lvl.height - 1);
+
+	glm::vec4 res = (get(x0, y0, level) * s_opposite + get(x1, y0, level) * s_ratio) * t_opposite +
+					(get(x0, y1, level) * s_opposite + get(x1, y1, level) * s_ratio) * t_ratio;
 	return res;
 }
 
+glm::vec4 TTexture::getTrilinear(float s, float t, float lod) const {
+	lod = glm::clamp(lod, 0.0f, float(levels() - 1));
+	int l0 = int(lod);
+	float frac = lod - l0;
+	if (frac <= 0.0f || l0 + 1 >= levels()) {
+		return getBilinear(s, t, l0);
+	}
+	return glm::mix(getBilinear(s, t, l0), getBilinear(s, t, l0 + 1), frac);
+}
+
+float TTexture::lod(const glm::vec2& dUVdx, const glm::vec2& dUVdy) const {
+	const glm::vec2 size(m_width, m_height);
+	float rho = std::max(glm::length(dUVdx * size), glm::length(dUVdy * size));
+	return rho > 1.0f ? std::log2(rho) : 0.0f;
+}
+
 void TTexture::set(int x, int y, const glm::vec4& color) {
 	if (x < 0 || x >= m_width || y < 0 || y >= m_height) {
 		return;
 	}
-	int index = x+y*m_width;//calcZOrder(x, y);
-	glm::vec4 newPixel = glm::mix(m_pixels[index], color, color.a);
-	m_pixels[index].r = newPixel.r;
-	m_pixels[index].g = newPixel.g;
-	m_pixels[index].b = newPixel.b;
-	m_pixels[index].a = newPixel.a;
+	int index = texelIndex(x, y, m_levels[0]);
+	if (m_format == TTextureFormat::RGBA32F) {
+		m_pixels[index] = glm::mix(m_pixels[index], color, color.a);
+	} else {
+		store(index, glm::mix(fetch(index), color, color.a));
+	}
 }
 
 void TTexture::clear(glm::vec4 color) {
-	std::fill(m_pixels.begin(), m_pixels.end(), color);
+	if (m_format == TTextureFormat::RGBA32F) {
+		std::fill(m_pixels.begin(), m_pixels.end(), color);
+		return;
+	}
+	const int count = int(m_data.size()) / bytesPerTexel(m_format);
+	for (int i = 0; i < count; i++) {
+		store(i, color);
+	}
 }
\ No newline at end of file
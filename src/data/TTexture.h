@@ -10,25 +10,72 @@
 
 #include "../stb/stb_image.h"
 
+enum class TTextureFormat {
+	RGBA32F, // 16 bytes per texel, used by render targets
+	RGBA8, // 4 bytes per texel
+	R8, // 1 byte per texel, samples as (r, 0, 0, 1)
+	RG16F // 4 bytes per texel (half floats), samples as (r, g, 0, 1)
+};
+
+enum class TTextureLayout {
+	Linear, // Row-major texels
+	Tiled // Row-major blocks of row-major texels, a block is one cache line
+};
+
+struct TMipLevel {
+	int width, height;
+	int stride; // Texels per row (Linear) or blocks per row (Tiled)
+	size_t offset; // First texel of the level in the texture storage
+};
+
 class TTexture {
 	friend class GFX;
 	friend class TFrameBuffer;
 public:
 	int width() const { return m_width; }
 	int height() const { return m_height; }
+	TTextureFormat format() const { return m_format; }
+
+	/// Changing the layout reorders the existing texels of every level
+	TTextureLayout layout() const { return m_layout; }
+	void layout(TTextureLayout layout);
 
-	glm::vec4 get(int x, int y) const;
+	glm::vec4 get(int x, int y) const { return get(x, y, 0); }
+	glm::vec4 get(int x, int y, int level) const;
 	glm::vec4 get(float s, float t) const;
-	glm::vec4 getBilinear(float s, float t) const;
+	glm::vec4 getBilinear(float s, float t, int level = 0) const;
+	glm::vec4 getTrilinear(float s, float t, float lod) const;
+
+	/// Trilinear sample with the level of detail picked from the screen-space
+	/// derivatives of the texture coordinates
+	glm::vec4 sample(const glm::vec2& uv, const glm::vec2& dUVdx, const glm::vec2& dUVdy) const {
+		return getTrilinear(uv.x, uv.y, lod(dUVdx, dUVdy));
+	}
+	float lod(const glm::vec2& dUVdx, const glm::vec2& dUVdy) const;
+
+	/// Writes only touch level 0, call generateMipmaps() again after editing
 	void set(int x, int y, const glm::vec4& color);
 
+	/// Builds the mip chain down to 1x1 from level 0 with a 2x2 box filter
+	void generateMipmaps();
+	int levels() const { return int(m_levels.size()); }
+	const TMipLevel& level(int i) const { return m_levels[i]; }
+
+	/// Texel storage of RGBA32F textures (empty for the packed formats)
 	std::vector<glm::vec4>& pixels() { return m_pixels; }
 
-	TTexture(int w, int h);
-	TTexture(const std::string& fileName);
+	/// Row 'y' of level 0 of an RGBA32F texture, in x order. Linear textures
+	/// return their own storage, Tiled ones gather the row into 'scratch'
+	/// (width() texels) and return it.
+	const glm::vec4* row(int y, glm::vec4* scratch) const;
+
+	TTexture(int w, int h, TTextureFormat format = TTextureFormat::RGBA32F);
+	TTexture(const std::string& fileName, TTextureFormat format = TTextureFormat::RGBA8, bool mipmaps = true);
 	virtual ~TTexture();
 
-	bool valid() const { return m_width != 0 && m_height != 0 && !m_pixels.empty(); }
+	bool valid() const { return m_width != 0 && m_height != 0 && (!m_pixels.empty() || !m_data.empty()); }
+
+	static int bytesPerTexel(TTextureFormat format);
 
 	static uint32_t calcZOrder(uint16_t xPos, uint16_t yPos);
 
@@ -37,7 +84,27 @@ protected:
 
 private:
 	std::vector<glm::vec4> m_pixels;
-	int m_width, m_height, m_size;
+	std::vector<uint8_t> m_data;
+	std::vector<TMipLevel> m_levels;
+	TTextureFormat m_format;
+	TTextureLayout m_layout;
+	int m_blockShift; // log2 of the block side in the Tiled layout
+	int m_width, m_height;
+
+	void allocate(int w, int h, TTextureFormat format);
+	void resizeStorage(size_t texels);
+	void buildLevels(int count);
+
+	int texelIndex(int x, int y, const TMipLevel& lvl) const {
+		if (m_layout == TTextureLayout::Linear) {
+			return int(lvl.offset) + x + y * lvl.stride;
+		}
+		const int mask = (1 << m_blockShift) - 1;
+		const int block = (y >> m_blockShift) * lvl.stride + (x >> m_blockShift);
+		return int(lvl.offset) + (block << (m_blockShift * 2)) + ((y & mask) << m_blockShift) + (x & mask);
+	}
+	glm::vec4 fetch(int index) const;
+	void store(int index, const glm::vec4& color);
 };
 
 #endif // T_TEXTURE_H
\ No newline at end of file
@@ -7,12 +7,12 @@
 #include "assimp/scene.h"
 #include "assimp/postprocess.h"
 
-class LightShader : public DefaultShader {
+class LightShader final : public DefaultShader {
 public:
 	TTexture* matcap;
 	glm::vec3 L = glm::vec3(-1.0f);
 
-	glm::vec4 pixel(TPixelInput in) override {
+	glm::vec4 pixel(const TPixelInput& in) override {
 		glm::vec3 V = glm::normalize(glm::vec3(-in.vertexPositions));
 
 		glm::vec4 supColor = DefaultShader::pixel(in);
@@ -43,6 +43,7 @@ int main(int argc, char** argv) {
 	Assimp::Importer imp;
 	const aiScene* scene = imp.ReadFile("teapot.obj",
 			aiPostProcessSteps::aiProcess_Triangulate |
+			aiPostProcessSteps::aiProcess_JoinIdenticalVertices |
 			aiPostProcessSteps::aiProcess_FlipUVs
 	);
 
@@ -92,6 +93,9 @@ int main(int argc, char** argv) {
 	TTexture* matcap = new TTexture("matcap4.jpg");
 	LightShader* shd = new LightShader();
 
+	gfx.tileAutoTune(true);
+	bool tuning = true;
+
 	const double timeStep = 1.0 / 60.0;
 	double lastTime = gfx.time();
 	double accum = 0.0;
@@ -131,10 +135,14 @@ int main(int argc, char** argv) {
 			// gfx.boundTexture(tex);
 
 			shd->matcap = matcap;
-			gfx.boundShader(shd);
-			gfx.mesh(vertices, indices);
+			gfx.mesh(*shd, vertices, indices);
 
 			gfx.flip();
+
+			if (tuning && !gfx.tileAutoTune()) {
+				tuning = false;
+				std::cout << "TILE SIZE: " << gfx.tileSize() << std::endl;
+			}
 		}
 	}
 
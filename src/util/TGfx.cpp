@@ -1,18 +1,30 @@
 #include "TGfx.h"
 
+#ifdef T_WINDOW
+#include "TWindow.h"
+#else
+/// Built without the window backend (TRENDER_WINDOW off): no window can be
+/// created, so every GFX is headless and m_window stays null
+class TWindow {
+public:
+	static TWindow* create(const std::string&, int, int, int, int) { return nullptr; }
+	bool poll() { return true; }
+	void present(TTexture*, TJobSystem&) {}
+	void presentAsync(TTexture*) {}
+	void finish() {}
+};
+#endif
+
 #include <iostream>
 #include <algorithm>
 #include <numeric>
 #include <future>
 #include <cstring>
 #include <cmath>
+#include <limits>
 #include <vector>
 #include <utility>
 
-void showError() {
-	std::cerr << SDL_GetError() << std::endl;
-}
-
 TShader* GFX::g_defaultShader = new DefaultShader();
 
 std::optional<GFX> GFX::create(const std::string title, int width, int height, float downScale) {
@@ -20,117 +32,208 @@ std::optional<GFX> GFX::create(const std::string title, int width, int height, f
 
 	int tw = int(width / downScale);
 	int th = int(height / downScale);
+	if (tw <= 0 || th <= 0) {
+		return {};
+	}
 
-	GFX gfx;
-	SDL_Init(SDL_INIT_VIDEO);
-
-	gfx.m_window = SDL_CreateWindow(
-		title.c_str(),
-		SDL_WINDOWPOS_CENTERED,
-		SDL_WINDOWPOS_CENTERED,
-		width, height,
-		SDL_WINDOW_SHOWN
-	);
-	if (gfx.m_window == nullptr) {
-		showError();
+	TWindow* window = TWindow::create(title, width, height, tw, th);
+	if (window == nullptr) {
 		return {};
 	}
 
-	gfx.m_renderer = SDL_CreateRenderer(gfx.m_window, 0, SDL_RENDERER_ACCELERATED);
-	if (gfx.m_renderer == nullptr) {
-		showError();
+	GFX gfx = createHeadless(tw, th).value();
+	gfx.m_window = window;
+	gfx.m_presentTarget = new TFrameBuffer(tw, th);
+	gfx.m_framePipelining = true;
+	return std::make_optional(gfx);
+}
+
+std::optional<GFX> GFX::createHeadless(int width, int height) {
+	if (width <= 0 || height <= 0) {
 		return {};
 	}
 
-	gfx.m_screenBuffer = SDL_CreateTexture(
-		gfx.m_renderer,
-		SDL_PIXELFORMAT_RGB24,
-		SDL_TEXTUREACCESS_STREAMING,
-		tw, th
-	);
+	const int tw = width;
+	const int th = height;
+
+	GFX gfx;
+	gfx.m_window = nullptr;
+	gfx.m_startTime = std::chrono::steady_clock::now();
 
 	gfx.m_shouldClose = false;
-	gfx.m_windowWidth = width;
-	gfx.m_windowHeight = height;
 	gfx.m_drawWidth = tw;
 	gfx.m_drawHeight = th;
 	gfx.m_modelMatrixStack.loadIdentity();
 	gfx.m_projectionMatrixStack.loadIdentity();
 	
 	gfx.m_defaultTarget = new TFrameBuffer(tw, th);
+	gfx.m_presentTarget = nullptr;
 	gfx.m_target = nullptr;
+	gfx.m_framePipelining = false;
 	gfx.clear();
 
 	gfx.m_boundTexture = nullptr;
 	gfx.m_boundShader = g_defaultShader;
+	gfx.m_deferred = false;
+	gfx.m_recordedTriangles = 0;
+	gfx.m_rasterMode = TRasterMode::EdgeFunction;
+	gfx.m_depthMode = TDepthMode::TestWrite;
+	gfx.m_blendMode = TBlendMode::Alpha;
+	gfx.m_guardBand = std::max(1.0f, float(T_GUARD_BAND) / std::max(tw, th));
+	gfx.simdLevel(detectSimdLevel());
+
+	gfx.m_tileSize = T_TILE_SIZE;
+	gfx.m_tileTuneIndex = -1;
+	gfx.m_tileTuneFrame = 0;
+	gfx.m_frameTime = 0.0;
+	gfx.m_jobs = new TJobSystem(0);
 
-	const int tilesX = (tw / T_TILE_SIZE);
-	const int tilesY = (th / T_TILE_SIZE);
-
-	gfx.m_screenTiles.resize(tilesX * tilesY);
+	return std::make_optional(gfx);
+}
 
-	for (int y = 0; y < tilesY; y++) {
-		for (int x = 0; x < tilesX; x++) {
-			gfx.m_screenTiles[x + y * tilesX] = TAABB(
-				x * T_TILE_SIZE,
-				y * T_TILE_SIZE,
-				x * T_TILE_SIZE + T_TILE_SIZE,
-				y * T_TILE_SIZE + T_TILE_SIZE
-			);
-		}
-	}
+double GFX::time() const {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count();
+}
 
-	return std::make_optional(gfx);
+void GFX::simdLevel(TSimdLevel level) {
+	TSimdLevel supported = detectSimdLevel();
+	m_simdLevel = int(level) > int(supported) ? supported : level;
+	m_rowKernel = rowKernel(m_simdLevel);
+	m_coveredRowKernel = coveredRowKernel(m_simdLevel);
 }
 
 void GFX::poll() {
-	while (SDL_PollEvent(&m_event)) {
-		if (m_event.type == SDL_QUIT) m_shouldClose = true;
+	if (m_window != nullptr && !m_window->poll()) {
+		m_shouldClose = true;
 	}
 }
 
 void GFX::flip() {
-	/// Flip screen
-	Uint8* pixels;
-	int pitch;
-	SDL_LockTexture(m_screenBuffer, nullptr, (void**) &pixels, &pitch);
-
-	for (int y = 0; y < m_drawHeight; y++) {
-		for (int x = 0; x < m_drawWidth; x++) {
-			int index = x + y * m_drawWidth;
-			glm::vec4 col = m_defaultTarget->texture()->get(x, y);
-			int pidx = index * 3;
-			int newR = int(col.r * 255);
-			int newG = int(col.g * 255);
-			int newB = int(col.b * 255);
-			pixels[pidx + 0] = newR;
-			pixels[pidx + 1] = newG;
-			pixels[pidx + 2] = newB;
-		}
+	submit();
+
+	if (m_tileTuneIndex >= 0) {
+		tuneTileSize();
+	}
+	m_frameTime = 0.0;
+
+	if (m_window == nullptr) {
+		return;
 	}
 
-	SDL_UnlockTexture(m_screenBuffer);
+	if (m_framePipelining) {
+		m_window->presentAsync(m_defaultTarget->texture());
+		std::swap(m_defaultTarget, m_presentTarget);
+	} else {
+		m_window->present(m_defaultTarget->texture(), *m_jobs);
+	}
+}
+
+/// Tile sizes tried by the auto-tuning, in order
+static const std::array<int, 4> g_tileTuneSizes = { 8, 16, 32, 64 };
+
+void GFX::tileSize(int size) {
+	m_tileSize = glm::clamp(size / T_HIZ_BLOCK * T_HIZ_BLOCK, T_HIZ_BLOCK, T_MAX_TILE_SIZE);
+	m_tileTuneIndex = -1;
+}
+
+void GFX::tileAutoTune(bool enabled) {
+	if (!enabled) {
+		m_tileTuneIndex = -1;
+		return;
+	}
+	m_tileTuneIndex = 0;
+	m_tileTuneFrame = 0;
+	m_tileTuneTimes.fill(std::numeric_limits<double>::max());
+	m_tileSize = g_tileTuneSizes[0];
+}
+
+void GFX::tuneTileSize() {
+	/// Frames that drew nothing say nothing about the tile size
+	if (m_frameTime <= 0.0) {
+		return;
+	}
+
+	/// The first frame of a size regrows the per-frame buffers, it's not timed
+	double& best = m_tileTuneTimes[m_tileTuneIndex];
+	if (m_tileTuneFrame++ > 0) {
+		best = std::min(best, m_frameTime);
+	}
+	if (m_tileTuneFrame < T_TILE_TUNE_FRAMES) {
+		return;
+	}
+
+	m_tileTuneFrame = 0;
+	if (++m_tileTuneIndex < int(g_tileTuneSizes.size())) {
+		m_tileSize = g_tileTuneSizes[m_tileTuneIndex];
+		return;
+	}
+
+	const int fastest = int(std::min_element(m_tileTuneTimes.begin(), m_tileTuneTimes.end()) - m_tileTuneTimes.begin());
+	m_tileSize = g_tileTuneSizes[fastest];
+	m_tileTuneIndex = -1;
+
+#ifndef NDEBUG
+	std::cout << "TILE SIZE AUTO-TUNED TO " << m_tileSize << std::endl;
+#endif
+}
 
-	SDL_RenderClear(m_renderer);
+void GFX::threads(int count) {
+	delete m_jobs;
+	m_jobs = new TJobSystem(count, m_threadAffinity);
+}
 
-	SDL_Rect rec = { 0, 0, m_windowWidth, m_windowHeight };
-	SDL_RenderCopy(m_renderer, m_screenBuffer, nullptr, &rec);
+void GFX::threadAffinity(const std::vector<int>& cpus) {
+	m_threadAffinity = cpus;
+	threads(m_jobs->threads());
+}
 
-	SDL_RenderPresent(m_renderer);
+void GFX::framePipelining(bool enabled) {
+	if (m_window == nullptr) {
+		return;
+	}
+	if (!enabled) {
+		m_window->finish();
+	}
+	m_framePipelining = enabled;
+}
+
+void GFX::readPixels(std::vector<uint8_t>& out) {
+	submit();
+
+	TTexture* color = target()->texture();
+	const int w = color->width();
+	const int h = color->height();
+	out.resize(size_t(w) * h * 4);
+
+	/// Only a Tiled target needs the scratch row
+	const int scratchSize = color->layout() == TTextureLayout::Tiled ? w : 0;
+
+	m_jobs->parallelFor(h, [&](int y) {
+		std::vector<glm::vec4> scratch(scratchSize);
+		packRow8(color->row(y, scratch.data()), &out[size_t(y) * w * 4], w, TPixelOrder::RGBA);
+	});
 }
 
 void GFX::destroy() {
+	if (m_window != nullptr) {
+		m_window->finish();
+	}
+	delete m_jobs;
 	delete m_defaultTarget;
-	SDL_DestroyTexture(m_screenBuffer);
-	SDL_DestroyRenderer(m_renderer);
-	SDL_DestroyWindow(m_window);
+	delete m_presentTarget;
+	delete m_window;
+	m_window = nullptr;
 }
 
 void GFX::clear(glm::vec3 color) {
+	submit();
 	target()->clear(glm::vec4(color, 1.0f));
+	m_stats = TRenderStats();
 }
 
+/// Also submits for line(), later calls find nothing pending
 void GFX::pixel(int x, int y, glm::vec4 color) {
+	submit();
 	target()->texture()->set(x, y, color);
 }
 
@@ -155,50 +258,41 @@ void GFX::line(int x1, int y1, int x2, int y2, glm::vec4 color) {
 	}
 }
 
-static TVertex toScreenSpace(TVertex v, int tw, int th) {
-	v.position.x = std::floor(0.5f * tw * (v.position.x + 1.0f));
-	v.position.y = std::floor(0.5f * th * (v.position.y + 1.0f));
+/// Snaps the vertex to T_SUBPIXEL_BITS of sub-pixel precision, 'fixed' gets
+/// the snapped position. The float position is the same point with pixel
+/// centers at whole coordinates.
+static TVertex toScreenSpace(TVertex v, int tw, int th, glm::ivec2& fixed) {
+	const float one = float(1 << T_SUBPIXEL_BITS);
+	fixed.x = int(std::lround(0.5f * tw * (v.position.x + 1.0f) * one));
+	fixed.y = int(std::lround(0.5f * th * (v.position.y + 1.0f) * one));
+	v.position.x = fixed.x / one - 0.5f;
+	v.position.y = fixed.y / one - 0.5f;
 	return v;
 }
 
-static glm::vec3 barycentric(
-	const glm::vec2& p,
-	const glm::vec4& v0,
-	const glm::vec4& v1,
-	const glm::vec4& v2
-) {
-	glm::vec4 ab = v1 - v0;
-	glm::vec4 ac = v2 - v0;
-	glm::vec2 pa = glm::vec2(v0.x, v0.y) - p;
-
-	glm::vec3 uv1 = glm::cross(glm::vec3(ac.x, ab.x, pa.x), glm::vec3(ac.y, ab.y, pa.y));
-
-	if (std::abs(uv1.z) < 1e-2) {
-		return glm::vec3(-1, 1, 1);
-	}
-	return (1.0f / uv1.z) * glm::vec3(uv1.z - (uv1.x + uv1.y), uv1.y, uv1.x);
-}
-
 static void clipPolygonComponent(
-	std::vector<TVertex> vertices, int comp, float factor,
-	std::vector<TVertex>& out)
+	const TClipPolygon& in, int comp, float factor,
+	TClipPolygon& out)
 {
-	TVertex prevVert = vertices[vertices.size()-1];
-	float prevComp = prevVert.position[comp] * factor;
-	bool prevInside = prevComp <= prevVert.position.w;
+	out.count = 0;
+
+	const TVertex* prevVert = &in.vertices[in.count - 1];
+	float prevComp = prevVert->position[comp] * factor;
+	bool prevInside = prevComp <= prevVert->position.w;
 
-	for (TVertex currVert : vertices) {
-		float currComp = currVert.position[comp] * factor;
-		bool currInside = currComp <= currVert.position.w;
+	for (int i = 0; i < in.count; i++) {
+		const TVertex* currVert = &in.vertices[i];
+		float currComp = currVert->position[comp] * factor;
+		bool currInside = currComp <= currVert->position.w;
 
 		if (currInside ^ prevInside) {
-			float lerpAmt = (prevVert.position.w - prevComp) /
-					((prevVert.position.w - prevComp) - (currVert.position.w - currComp));
-			out.push_back(prevVert.lerp(currVert, lerpAmt));
+			float lerpAmt = (prevVert->position.w - prevComp) /
+					((prevVert->position.w - prevComp) - (currVert->position.w - currComp));
+			out.vertices[out.count++] = prevVert->lerp(*currVert, lerpAmt);
 		}
 
 		if (currInside) {
-			out.push_back(currVert);
+			out.vertices[out.count++] = *currVert;
 		}
 
 		prevVert = currVert;
@@ -207,36 +301,36 @@ static void clipPolygonComponent(
 	}
 }
 
+/// Clips against the planes -limit * w <= position[comp] <= limit * w
 static bool clipPolygonAxis(
-	std::vector<TVertex>& vertices,
-	std::vector<TVertex>& aux,
-	int comp
+	TClipPolygon& polygon,
+	TClipPolygon& aux,
+	int comp,
+	float limit = 1.0f
 )
 {
-	clipPolygonComponent(vertices, comp, 1.0f, aux);
-	vertices.clear();
-
-	if (aux.empty()) {
+	clipPolygonComponent(polygon, comp, 1.0f / limit, aux);
+	if (aux.count == 0) {
+		polygon.count = 0;
 		return false;
 	}
 
-	clipPolygonComponent(aux, comp, -1.0f, vertices);
-	aux.clear();
-
-	return !vertices.empty();
+	clipPolygonComponent(aux, comp, -1.0f / limit, polygon);
+	return polygon.count > 0;
 }
 
-static float wrap(float flt, float max) {
-	if (flt > max) {
-		flt -= max;
-	}
-	if (flt < 0.0f) {
-		flt += max;
+/// Bit i * 2 + s is set when the vertex is outside of the plane
+/// (s ? -1 : 1) * position[i] <= limit[i] * position.w
+static int clipOutcode(const glm::vec4& p, const glm::vec3& limit) {
+	int code = 0;
+	for (int i = 0; i < 3; i++) {
+		if (p[i] > limit[i] * p.w) code |= 1 << (i * 2);
+		if (-p[i] > limit[i] * p.w) code |= 1 << (i * 2 + 1);
 	}
-	return flt;
+	return code;
 }
 
-std::optional<TTriangle> GFX::createTriangle(const TVertex& v0, const TVertex& v1, const TVertex& v2) {
+std::optional<TTriangle> GFX::createTriangle(const TVertex& v0, const TVertex& v1, const TVertex& v2, const glm::vec3& eye) {
 	TTriangle tri;
 	tri.v0 = v0;
 	tri.v1 = v1;
@@ -259,7 +353,6 @@ std::optional<TTriangle> GFX::createTriangle(const TVertex& v0, const TVertex& v
 	glm::vec4 _vs2 = vt2.position - vt0.position;
 
 	/// Cull
-	glm::vec3 eye = glm::vec3(modelView().matrix()[3]);
 	glm::vec3 tV = glm::normalize(glm::vec3(vt0.position) - eye);
 	glm::vec3 tN = glm::cross(glm::vec3(_vs1), glm::vec3(_vs2));
 
@@ -268,209 +361,586 @@ std::optional<TTriangle> GFX::createTriangle(const TVertex& v0, const TVertex& v
 	}
 
 	/// To screen space
-	vt0 = toScreenSpace(vt0, m_drawWidth, m_drawHeight);
-	vt1 = toScreenSpace(vt1, m_drawWidth, m_drawHeight);
-	vt2 = toScreenSpace(vt2, m_drawWidth, m_drawHeight);
+	glm::ivec2 f0, f1, f2;
+	vt0 = toScreenSpace(vt0, m_drawWidth, m_drawHeight, f0);
+	vt1 = toScreenSpace(vt1, m_drawWidth, m_drawHeight, f1);
+	vt2 = toScreenSpace(vt2, m_drawWidth, m_drawHeight, f2);
 
-	tri.maxX = std::max(vt0.position.x, std::max(vt1.position.x, vt2.position.x));
-	tri.minX = std::min(vt0.position.x, std::min(vt1.position.x, vt2.position.x));
-	tri.maxY = std::max(vt0.position.y, std::max(vt1.position.y, vt2.position.y));
-	tri.minY = std::min(vt0.position.y, std::min(vt1.position.y, vt2.position.y));
+	tri.maxX = int(std::ceil(std::max(vt0.position.x, std::max(vt1.position.x, vt2.position.x))));
+	tri.minX = int(std::floor(std::min(vt0.position.x, std::min(vt1.position.x, vt2.position.x))));
+	tri.maxY = int(std::ceil(std::max(vt0.position.y, std::max(vt1.position.y, vt2.position.y))));
+	tri.minY = int(std::floor(std::min(vt0.position.y, std::min(vt1.position.y, vt2.position.y))));
 
 	tri.v0 = vt0;
 	tri.v1 = vt1;
 	tri.v2 = vt2;
 
+	/// Depth is the weighted mean of the 1/w, covered pixels have weights in
+	/// [0, 1] up to the rounding of the float interpolation
+	const float maxInvW = std::max(1.0f / tri.vp0.w, std::max(1.0f / tri.vp1.w, 1.0f / tri.vp2.w));
+	tri.maxZ = maxInvW / 3.0f * (1.0f + 1e-4f);
+
+	/// Triangle setup (edge functions)
+	if (!tri.setup(f0, f1, f2)) {
+		return {};
+	}
+
 	return std::make_optional(tri);
 }
 
-std::vector<TTile> GFX::buildTiles(const std::vector<TTriangle>& tris) {
-	moodycamel::ConcurrentQueue<std::pair<int, int>> tileIDs;
+/// Splits [0, count) into 'chunks' contiguous ranges, returns the c-th one
+static void chunkRange(int count, int chunks, int c, int& begin, int& end) {
+	begin = int((long long)(count) * c / chunks);
+	end = int((long long)(count) * (c + 1) / chunks);
+}
 
-	const int tilesX = (m_drawWidth / T_TILE_SIZE);
-	const int tilesY = (m_drawHeight / T_TILE_SIZE);
-	const glm::vec2 res(m_drawWidth, m_drawHeight);
-	const glm::vec2 tilesXY(tilesX, tilesY);
-	
-	#pragma omp parallel for schedule(dynamic)
-	for (int triangleID = 0; triangleID < tris.size(); triangleID++) {
-		TTriangle tri = tris[triangleID];
-		glm::vec2 triMin(tri.minX, tri.minY);
-		glm::vec2 triMax(tri.maxX, tri.maxY);
+/// Tiles [tmin, tmax) overlapping the pixel bounds clipped to the screen
+void GFX::tileBounds(const TTriangle& tri, glm::ivec2& tmin, glm::ivec2& tmax) const {
+	const glm::ivec2 pmin = glm::max(glm::ivec2(tri.minX, tri.minY), glm::ivec2(0));
+	const glm::ivec2 pmax = glm::min(glm::ivec2(tri.maxX, tri.maxY), glm::ivec2(m_drawWidth - 1, m_drawHeight - 1));
 
-		triMin /= res;
-		triMax /= res;
+	tmin = pmin / m_tileSize;
+	tmax = pmax / m_tileSize + 1;
+	if (pmin.x > pmax.x || pmin.y > pmax.y) {
+		tmax = tmin;
+	}
+}
 
-		triMin *= tilesXY;
-		triMax *= tilesXY;
+TCoverage GFX::tileCoverage(const TTriangle& tri, int tx0, int ty0, int tx1, int ty1) const {
+	return tri.coverage(
+		tx0 * m_tileSize, ty0 * m_tileSize,
+		std::min(tx1 * m_tileSize, m_drawWidth) - 1, std::min(ty1 * m_tileSize, m_drawHeight) - 1
+	);
+}
 
-		triMin = glm::floor(triMin);
-		triMax = glm::ceil(triMax);
+/// Calls visit(tx, ty) for every tile the edge functions cover.
+/// Triangles larger than a block of tiles test the blocks first: empty
+/// ones are skipped and fully covered ones need no per-tile test.
+template <typename VisitT>
+void GFX::forEachTile(const TTriangle& tri, VisitT&& visit) const {
+	glm::ivec2 tmin, tmax;
+	tileBounds(tri, tmin, tmax);
+
+	/// A single tile, the bounds already are the answer
+	if (tmax.x - tmin.x <= 1 && tmax.y - tmin.y <= 1) {
+		for (int ty = tmin.y; ty < tmax.y; ty++) {
+			for (int tx = tmin.x; tx < tmax.x; tx++) {
+				visit(tx, ty);
+			}
+		}
+		return;
+	}
+
+	const bool blocks = tmax.x - tmin.x > T_BIN_BLOCK || tmax.y - tmin.y > T_BIN_BLOCK;
+	const int step = blocks ? T_BIN_BLOCK : std::max(tmax.x - tmin.x, tmax.y - tmin.y);
+
+	for (int by = tmin.y; by < tmax.y; by += step) {
+		for (int bx = tmin.x; bx < tmax.x; bx += step) {
+			const int bx1 = std::min(bx + step, tmax.x);
+			const int by1 = std::min(by + step, tmax.y);
+
+			TCoverage cov = blocks ? tileCoverage(tri, bx, by, bx1, by1) : TCoverage::Partial;
+			if (cov == TCoverage::None) {
+				continue;
+			}
 
-		for (int ty = triMin.y; ty < triMax.y; ty++) {
-			for (int tx = triMin.x; tx < triMax.x; tx++) {
-				int tileID = tx + ty * tilesX;
-				tileIDs.enqueue(std::make_pair(tileID, triangleID));
+			for (int ty = by; ty < by1; ty++) {
+				for (int tx = bx; tx < bx1; tx++) {
+					if (cov == TCoverage::Full || tileCoverage(tri, tx, ty, tx + 1, ty + 1) != TCoverage::None) {
+						visit(tx, ty);
+					}
+				}
 			}
 		}
 	}
+}
 
-	std::vector<std::pair<int, int>> tileIDsv;
-	tileIDsv.reserve(tileIDs.size_approx());
+/// Hierarchical Z, with the depth of the draws submitted before: a tile
+/// is skipped when the triangle can't get closer than the farthest depth
+/// stored in every one of its blocks
+bool GFX::occluded(const TTriangle& tri, int tx, int ty) const {
+	const TDrawState& state = m_states[m_draws[tri.draw].state];
+	if (state.depthMode == TDepthMode::Off) {
+		return false;
+	}
 
-	std::pair<int, int> tileID;
-	while (tileIDs.try_dequeue(tileID)) {
-		tileIDsv.push_back(tileID);
+	TFrameBuffer* target = state.target;
+	const int bx0 = tx * m_tileSize / T_HIZ_BLOCK;
+	const int by0 = ty * m_tileSize / T_HIZ_BLOCK;
+	const int bx1 = std::min(bx0 + m_tileSize / T_HIZ_BLOCK, target->hiZWidth());
+	const int by1 = std::min(by0 + m_tileSize / T_HIZ_BLOCK, target->hiZHeight());
+	if (bx0 >= bx1 || by0 >= by1) {
+		return false;
 	}
 
-	std::sort(tileIDsv.begin(), tileIDsv.end(), [&](std::pair<int, int> a, std::pair<int, int> b){
-		return a.first < b.first;
-	});
+	for (int by = by0; by < by1; by++) {
+		for (int bx = bx0; bx < bx1; bx++) {
+			if (target->hiZ(bx, by) < tri.maxZ) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
 
-	std::vector<TTile> tiles;
-	int tid = -1;
-	for (auto ttid : tileIDsv) {
-		if (ttid.first != tid) {
-			tiles.push_back(TTile());
-			TTile& tile = tiles.back();
-			tile.x = (ttid.first % tilesX) * T_TILE_SIZE;
-			tile.y = (ttid.first / tilesX) * T_TILE_SIZE;
-			tid = ttid.first;
+/// Binning. Every chunk of triangles is binned by a single thread into its
+/// own counters, chunks are contiguous and merged in order, so the triangles
+/// of a tile always come out in submission order.
+
+/// Pass 1: count the triangles of chunk 'c' per tile
+void GFX::countChunk(int c) {
+	const int numTiles = m_tilesX * m_tilesY;
+	int* counts = &m_binOffsets[size_t(c) * numTiles];
+	std::fill(counts, counts + numTiles, 0);
+
+	for (const TTriangle& tri : m_chunkTriangles[c]) {
+		forEachTile(tri, [&](int tx, int ty) {
+			if (occluded(tri, tx, ty)) {
+				m_chunkRejected[c]++;
+			} else {
+				counts[tx + ty * m_tilesX]++;
+			}
+		});
+	}
+}
+
+/// Pass 2: prefix sums. Per tile across chunks for the tiles of block 'b',
+/// then across blocks, then across the tiles of each block.
+void GFX::sumTiles(int b) {
+	const int numTiles = m_tilesX * m_tilesY;
+	int begin, end;
+	chunkRange(numTiles, m_numBlocks, b, begin, end);
+
+	int total = 0;
+	for (int tileID = begin; tileID < end; tileID++) {
+		int sum = 0;
+		for (int c = 0; c < m_numChunks; c++) {
+			int& offset = m_binOffsets[size_t(c) * numTiles + tileID];
+			int count = offset;
+			offset = sum;
+			sum += count;
 		}
-		TTile& tile = tiles.back();
-		tile.triangles.push_back(tris[ttid.second]);
+		m_tileCount[tileID] = sum;
+		total += sum;
 	}
-	
-	// std::cout << "TILES THIS FRAME: " << tiles.size() << std::endl;
-	return tiles;
+	m_blockStart[b + 1] = total;
 }
 
-void GFX::drawTile(const TTile& tile) {
-	const float BX = 1.0f / m_drawWidth;
-	const float BY = 1.0f / m_drawHeight;
-
-	for (TTriangle tri : tile.triangles) {
-		for (int y = tile.y; y < tile.y + T_TILE_SIZE; y++) {
-			for (int x = tile.x; x < tile.x + T_TILE_SIZE; x++) {
-				glm::vec3 bc = barycentric(
-					glm::vec2(x, y),
-					tri.v0.position,
-					tri.v1.position,
-					tri.v2.position
-				);
-
-				if (bc.x < -BX || bc.y < -BY || bc.z < 0.0f) { continue; }
-
-				glm::vec3 P = glm::vec3(
-					bc.x / tri.vp0.w,
-					bc.y / tri.vp1.w,
-					bc.z / tri.vp2.w
-				);
-				float d = (P.x + P.y + P.z);
-				P = (1.0f / d) * P;
-
-				float z = d / 3.0f;
-
-				if (target()->depth(x, y) < z) {
-					glm::vec4 col = P.x * tri.v0.color + P.y * tri.v1.color + P.z * tri.v2.color;
-					glm::vec2 uv = P.x * tri.v0.uv + P.y * tri.v1.uv + P.z * tri.v2.uv;
-					uv.x = wrap(uv.x, 1.0f);
-					uv.y = wrap(uv.y, 1.0f);
-					
-					TPixelInput pi;
-					pi.boundTexture = m_boundTexture;
-					pi.vertexPositions = P.x * tri.vp0 + P.y * tri.vp1 + P.z * tri.vp2;
-					pi.normals = glm::normalize(P.x * tri.v0.normal + P.y * tri.v1.normal + P.z * tri.v2.normal);
-					pi.texCoords = uv;
-					pi.vertexColors = col;
-
-					glm::vec4 pixelColor = glm::clamp(boundShader()->pixel(pi), 0.0f, 1.0f);
-					if (!boundShader()->m_discard) {
-						pixel(x, y, pixelColor);
-						target()->depth(x, y, z);
+void GFX::prefixBlocks() {
+	m_blockStart[0] = 0;
+	for (int b = 0; b < m_numBlocks; b++) {
+		m_blockStart[b + 1] += m_blockStart[b];
+	}
+	m_tileStart[m_tilesX * m_tilesY] = m_blockStart[m_numBlocks];
+	m_binTriangles.resize(m_blockStart[m_numBlocks]);
+}
+
+void GFX::offsetTiles(int b) {
+	const int numTiles = m_tilesX * m_tilesY;
+	int begin, end;
+	chunkRange(numTiles, m_numBlocks, b, begin, end);
+
+	int start = m_blockStart[b];
+	for (int tileID = begin; tileID < end; tileID++) {
+		m_tileStart[tileID] = start;
+		for (int c = 0; c < m_numChunks; c++) {
+			m_binOffsets[size_t(c) * numTiles + tileID] += start;
+		}
+		start += m_tileCount[tileID];
+	}
+}
+
+/// Pass 3: scatter the triangle IDs of chunk 'c' into their tile ranges
+void GFX::scatterChunk(int c) {
+	int* offsets = &m_binOffsets[size_t(c) * m_tilesX * m_tilesY];
+	const std::vector<TTriangle>& tris = m_chunkTriangles[c];
+	const int first = m_chunkStart[c];
+
+	for (int i = 0; i < int(tris.size()); i++) {
+		forEachTile(tris[i], [&](int tx, int ty) {
+			if (!occluded(tris[i], tx, ty)) {
+				m_binTriangles[offsets[tx + ty * m_tilesX]++] = first + i;
+			}
+		});
+	}
+}
+
+/// Lists the non-empty tiles, clipped to the screen
+void GFX::collectTiles() {
+	const int numTiles = m_tilesX * m_tilesY;
+
+	m_tiles.clear();
+	for (int tileID = 0; tileID < numTiles; tileID++) {
+		if (m_tileCount[tileID] > 0) {
+			TTile tile;
+			tile.x = (tileID % m_tilesX) * m_tileSize;
+			tile.y = (tileID / m_tilesX) * m_tileSize;
+			tile.width = std::min(m_tileSize, m_drawWidth - tile.x);
+			tile.height = std::min(m_tileSize, m_drawHeight - tile.y);
+			tile.first = m_tileStart[tileID];
+			tile.count = m_tileCount[tileID];
+			m_tiles.push_back(tile);
+		}
+	}
+
+	const size_t numTris = m_chunkStart[m_numChunks];
+	m_stats.triangles += int(numTris);
+	m_stats.binnedTriangles += int(m_binTriangles.size());
+	m_stats.tiles += int(m_tiles.size());
+	m_stats.hiZRejected += std::accumulate(m_chunkRejected.begin(), m_chunkRejected.end(), 0);
+
+	/// Bytes of this submit only, binBytes adds up every submit since clear()
+	const size_t binBytes = numTris * sizeof(TTriangle) +
+							m_binTriangles.size() * sizeof(int) +
+							m_tiles.size() * sizeof(TTile);
+	m_stats.binBytes += binBytes;
+
+#ifndef NDEBUG
+	std::cout << "BINNED " << m_binTriangles.size() << " TRIANGLE REFS IN " << m_tiles.size() << " TILES: " <<
+		binBytes << " bytes (" << m_binTriangles.size() * sizeof(TTriangle) << " bytes if copied)" << std::endl;
+#endif
+}
+
+/// Pixels of the triangle bounds inside the tile, at most half of the bounds
+/// (a triangle covers no more than that), plus a fixed cost per triangle
+int64_t GFX::tileCost(const TTile& tile) const {
+	const int* triangleIDs = &m_binTriangles[tile.first];
+
+	int64_t cost = 0;
+	for (int i = 0; i < tile.count; i++) {
+		const TTriangle& tri = m_triangles[triangleIDs[i]];
+		const int w = std::min(tri.maxX, tile.x + tile.width - 1) - std::max(tri.minX, tile.x) + 1;
+		const int h = std::min(tri.maxY, tile.y + tile.height - 1) - std::max(tri.minY, tile.y) + 1;
+		if (w <= 0 || h <= 0) {
+			continue;
+		}
+		const int64_t half = int64_t(tri.maxX - tri.minX + 1) * (tri.maxY - tri.minY + 1) / 2;
+		cost += std::min(int64_t(w) * h, half) + T_TILE_TRIANGLE_COST;
+	}
+	return cost;
+}
+
+/// Orders the tiles, with their costs estimated, by decreasing cost so the heavy ones start first and
+/// the light ones fill the gaps at the end of the pass. Tiles too heavy to
+/// be balanced that way are first split into quadrants aligned to the Hi-Z
+/// blocks, until they're light enough or a single block wide.
+void GFX::scheduleTiles() {
+	std::vector<TTile>& tiles = m_tiles;
+
+	const int threads = m_jobs->threads();
+	if (threads > 1) {
+		int64_t total = 0;
+		for (const TTile& tile : tiles) {
+			total += tile.cost;
+		}
+		const int64_t limit = total / (int64_t(T_TILE_SPLIT_SHARE) * threads);
+
+		const int numTiles = int(tiles.size());
+		for (int i = 0; i < numTiles; i++) {
+			if (tiles[i].cost <= limit) {
+				continue;
+			}
+			m_stats.splitTiles++;
+
+			/// Split in place: the first quadrant replaces the tile, the
+			/// others go to the end and are split again when still too heavy
+			std::vector<TTile> pending = { tiles[i] };
+			bool first = true;
+			while (!pending.empty()) {
+				TTile tile = pending.back();
+				pending.pop_back();
+
+				/// Halves stay whole Hi-Z blocks, a side of one block or less
+				/// (e.g. a 1 px wide edge tile) isn't split
+				const int halfW = std::max(T_HIZ_BLOCK, (tile.width / 2 + T_HIZ_BLOCK - 1) / T_HIZ_BLOCK * T_HIZ_BLOCK);
+				const int halfH = std::max(T_HIZ_BLOCK, (tile.height / 2 + T_HIZ_BLOCK - 1) / T_HIZ_BLOCK * T_HIZ_BLOCK);
+				if (tile.cost <= limit || (halfW >= tile.width && halfH >= tile.height)) {
+					if (first) {
+						tiles[i] = tile;
+						first = false;
 					} else {
-						boundShader()->m_discard = false;
+						tiles.push_back(tile);
+					}
+					continue;
+				}
+
+				for (int qy = 0; qy < tile.height; qy += halfH) {
+					for (int qx = 0; qx < tile.width; qx += halfW) {
+						TTile sub = tile;
+						sub.x = tile.x + qx;
+						sub.y = tile.y + qy;
+						sub.width = std::min(halfW, tile.width - qx);
+						sub.height = std::min(halfH, tile.height - qy);
+						sub.cost = tileCost(sub);
+						if (sub.cost > 0) {
+							pending.push_back(sub);
+						}
 					}
 				}
 			}
+
+			/// Every quadrant missed the triangles, nothing left to draw
+			if (first) {
+				tiles[i].count = 0;
+				tiles[i].cost = 0;
+			}
 		}
 	}
 
-	// line(tile.x, tile.y, tile.x+T_TILE_SIZE, tile.y, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
-	// line(tile.x+T_TILE_SIZE, tile.y, tile.x+T_TILE_SIZE, tile.y+T_TILE_SIZE, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
-	// line(tile.x, tile.y+T_TILE_SIZE, tile.x+T_TILE_SIZE, tile.y+T_TILE_SIZE, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
-	// line(tile.x, tile.y, tile.x, tile.y+T_TILE_SIZE, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
+	std::sort(tiles.begin(), tiles.end(), [](const TTile& a, const TTile& b) {
+		return a.cost > b.cost;
+	});
 }
 
-std::vector<TVertex> GFX::triangleProcess(const TVertex& v0, const TVertex& v1, const TVertex& v2) {
-	glm::mat4 mvp = projection().matrix() * modelView().matrix();
-
-	std::vector<TVertex> vertices, aux;
-	vertices.insert(vertices.end(), {
-		boundShader()->vertex(projection().matrix(), modelView().matrix(), v0),
-		boundShader()->vertex(projection().matrix(), modelView().matrix(), v1),
-		boundShader()->vertex(projection().matrix(), modelView().matrix(), v2)
-	});
-	
-	std::vector<TVertex> triangles;
-	
-	if (clipPolygonAxis(vertices, aux, 0) &&
-		clipPolygonAxis(vertices, aux, 1) &&
-		clipPolygonAxis(vertices, aux, 2))
+bool GFX::triangleProcess(const TVertex& v0, const TVertex& v1, const TVertex& v2, TClipPolygon& out) {
+	out.vertices[0] = v0;
+	out.vertices[1] = v1;
+	out.vertices[2] = v2;
+	out.count = 3;
+
+	/// Trivial reject: fully outside of one of the frustum planes
+	const glm::vec3 frustum(1.0f);
+	if ((clipOutcode(v0.position, frustum) &
+		 clipOutcode(v1.position, frustum) &
+		 clipOutcode(v2.position, frustum)) != 0)
 	{
-		TVertex initial = vertices[0];
-		for (int i = 1; i < vertices.size() - 1; i++) {
-			TTriangle tri;
-			triangles.push_back(initial);
-			triangles.push_back(vertices[i]);
-			triangles.push_back(vertices[i+1]);
-		}
+		return false;
+	}
+
+	/// Only near/far and the guard band need geometric clipping,
+	/// the rest is scissored by the tile grid.
+	const glm::vec3 guardBand(m_guardBand, m_guardBand, 1.0f);
+	const int c0 = clipOutcode(v0.position, guardBand);
+	const int c1 = clipOutcode(v1.position, guardBand);
+	const int c2 = clipOutcode(v2.position, guardBand);
+
+	/// Trivial accept
+	if ((c0 | c1 | c2) == 0) {
+		return true;
 	}
-	return triangles;
+
+	TClipPolygon aux;
+	const int outside = c0 | c1 | c2;
+	if ((outside & 0x30) && !clipPolygonAxis(out, aux, 2)) return false;
+	if ((outside & 0x03) && !clipPolygonAxis(out, aux, 0, m_guardBand)) return false;
+	if ((outside & 0x0C) && !clipPolygonAxis(out, aux, 1, m_guardBand)) return false;
+	return true;
 }
 
 void GFX::mesh(const std::vector<TVertex>& vertices, const std::vector<int>& indices) {
-	moodycamel::ConcurrentQueue<TTriangle> triangles;
+	mesh(*boundShader(), vertices, indices);
+}
+
+void GFX::deferred(bool enabled) {
+	if (!enabled) {
+		submit();
+	}
+	m_deferred = enabled;
+}
+
+void GFX::submit() {
+	if (m_draws.empty()) {
+		return;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
 
 	auto clk = BEGIN_BENCH;
 
-	#pragma omp parallel for schedule(dynamic)
-	for (int i = 0; i < indices.size(); i+=3) {
-		TVertex v0 = vertices[indices[i + 0]];
-		TVertex v1 = vertices[indices[i + 1]];
-		TVertex v2 = vertices[indices[i + 2]];
+	int numVertices = 0, numTriangles = 0;
+	for (TDrawCommand& draw : m_draws) {
+		draw.firstVertex = numVertices;
+		draw.firstTriangle = numTriangles;
+		numVertices += draw.vertexCount;
+		numTriangles += int(draw.indices->size() / 3);
+	}
+	m_transformed.resize(numVertices);
+	m_stats.vertices += numVertices;
+
+	/// The last column and row of tiles are partial when the size isn't a
+	/// multiple of the tile size
+	m_tilesX = (m_drawWidth + m_tileSize - 1) / m_tileSize;
+	m_tilesY = (m_drawHeight + m_tileSize - 1) / m_tileSize;
+	const int numTiles = m_tilesX * m_tilesY;
+
+	const int threads = m_jobs->threads();
+	m_numChunks = std::max(1, std::min(threads, numTriangles));
+	m_numBlocks = std::max(1, std::min(threads, numTiles));
+	m_chunkTriangles.resize(m_numChunks);
+	m_chunkStart.resize(m_numChunks + 1);
+	m_chunkRejected.assign(m_numChunks, 0);
+	m_binOffsets.resize(size_t(m_numChunks) * numTiles);
+	m_tileStart.resize(numTiles + 1);
+	m_tileCount.resize(numTiles);
+	m_blockStart.resize(m_numBlocks + 1);
+
+	/// The stages as a task graph. A chunk of triangles is assembled and
+	/// counted into the bins as soon as the vertices of its draws are
+	/// shaded, alongside the vertex stage of later draws, only the passes
+	/// that need every chunk wait for all of them.
+	TTaskGraph graph;
+
+	/// Hierarchical Z of every depth tested target, for the binning
+	std::vector<TFrameBuffer*> hiZTargets;
+	for (const TDrawState& state : m_states) {
+		if (state.depthMode != TDepthMode::Off &&
+			std::find(hiZTargets.begin(), hiZTargets.end(), state.target) == hiZTargets.end())
+		{
+			hiZTargets.push_back(state.target);
+		}
+	}
 
-		std::vector<TVertex> verticesProc = triangleProcess(v0, v1, v2);
-		for (int i = 0; i < verticesProc.size(); i+=3) {
-			TVertex vt0 = verticesProc[i];
-			TVertex vt1 = verticesProc[i+1];
-			TVertex vt2 = verticesProc[i+2];
+	std::vector<int> hiZTasks;
+	for (TFrameBuffer* target : hiZTargets) {
+		hiZTasks.push_back(graph.add([target](int by) { target->refreshHiZ(by); }, target->hiZHeight()));
+	}
 
-			std::optional<TTriangle> optTri = createTriangle(vt0, vt1, vt2);
-			if (optTri.has_value()) {
-				triangles.enqueue(optTri.value());
+	std::vector<int> vertexTasks(m_draws.size());
+	for (size_t d = 0; d < m_draws.size(); d++) {
+		const TDrawCommand* draw = &m_draws[d];
+		const int count = draw->vertexCount;
+		vertexTasks[d] = graph.add([this, draw, count](int i) {
+			draw->shadeVertices(*this, *draw, i * T_JOB_VERTICES, std::min(count, (i + 1) * T_JOB_VERTICES));
+		}, (count + T_JOB_VERTICES - 1) / T_JOB_VERTICES);
+	}
+
+	const int place = graph.add([this](int) { placeChunks(); });
+	const int sums = graph.add([this](int b) { sumTiles(b); }, m_numBlocks);
+
+	for (int c = 0; c < m_numChunks; c++) {
+		int begin, end;
+		chunkRange(numTriangles, m_numChunks, c, begin, end);
+
+		const int assemble = graph.add([this, c, begin, end](int) { assembleChunk(c, begin, end); });
+		for (size_t d = 0; d < m_draws.size(); d++) {
+			const int first = m_draws[d].firstTriangle;
+			const int last = first + int(m_draws[d].indices->size() / 3);
+			if (first < end && last > begin) {
+				graph.after(assemble, vertexTasks[d]);
 			}
 		}
+
+		const int count = graph.add([this, c](int) { countChunk(c); });
+		graph.after(count, assemble);
+		for (int hiZ : hiZTasks) {
+			graph.after(count, hiZ);
+		}
+
+		graph.after(place, assemble);
+		graph.after(sums, count);
 	}
-	END_BENCH(clk, "CLIPPING and TRANSFORMATIONS");
 
-	std::vector<TTriangle> trianglesVec;
-	trianglesVec.reserve(triangles.size_approx());
-	
-	TTriangle tri;
-	while (triangles.try_dequeue(tri)) {
-		trianglesVec.push_back(tri);
+	const int merge = graph.add([this](int c) { mergeChunk(c); }, m_numChunks);
+	graph.after(merge, place);
+
+	const int prefix = graph.add([this](int) { prefixBlocks(); });
+	graph.after(prefix, sums);
+
+	const int offsets = graph.add([this](int b) { offsetTiles(b); }, m_numBlocks);
+	graph.after(offsets, prefix);
+
+	const int scatter = graph.add([this](int c) { scatterChunk(c); }, m_numChunks);
+	graph.after(scatter, offsets);
+	graph.after(scatter, place);
+
+	/// The cost and raster stages get one invocation per tile, their counts
+	/// are set by the stage before them
+	const int costs = graph.add([this](int i) { m_tiles[i].cost = tileCost(m_tiles[i]); }, 0);
+	const int raster = graph.add([this](int i) { drawTile(m_tiles[i]); }, 0);
+
+	const int collect = graph.add([this, &graph, costs](int) {
+		collectTiles();
+		graph.count(costs, int(m_tiles.size()));
+	});
+	graph.after(collect, scatter);
+	graph.after(costs, collect);
+	graph.after(costs, merge);
+
+	const int schedule = graph.add([this, &graph, raster](int) {
+		scheduleTiles();
+		graph.count(raster, int(m_tiles.size()));
+	});
+	graph.after(schedule, costs);
+	graph.after(raster, schedule);
+
+	m_jobs->run(graph);
+	END_BENCH(clk, "SUBMIT");
+
+	m_draws.clear();
+	m_states.clear();
+	m_recordedTriangles = 0;
+
+	m_frameTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void GFX::drawTile(const TTile& tile) {
+	const int* triangleIDs = &m_binTriangles[tile.first];
+
+	/// Runs of consecutive triangles from the same draw share its raster loop
+	int first = 0;
+	while (first < tile.count) {
+		const int draw = m_triangles[triangleIDs[first]].draw;
+		int last = first + 1;
+		while (last < tile.count && m_triangles[triangleIDs[last]].draw == draw) {
+			last++;
+		}
+
+		const TDrawCommand& cmd = m_draws[draw];
+		cmd.drawTriangles(*this, tile, cmd, triangleIDs + first, last - first);
+		first = last;
 	}
+}
+
+/// Clips and sets up the triangles [begin, end) of the submit into the
+/// chunk's own list
+void GFX::assembleChunk(int c, int begin, int end) {
+	std::vector<TTriangle>& triangles = m_chunkTriangles[c];
+	triangles.clear();
+	triangles.reserve(end - begin);
+
+	int d = 0;
+	TClipPolygon polygon;
+	for (int t = begin; t < end; t++) {
+		while (t >= m_draws[d].firstTriangle + int(m_draws[d].indices->size() / 3)) {
+			d++;
+		}
+
+		const TDrawCommand& draw = m_draws[d];
+		const int* indices = &(*draw.indices)[(t - draw.firstTriangle) * 3];
+		const TVertex* vertices = &m_transformed[draw.firstVertex];
+		const glm::vec3 eye = glm::vec3(draw.modelView[3]);
 
-	clk = BEGIN_BENCH;
-	std::vector<TTile> tiles = buildTiles(trianglesVec);
-	END_BENCH(clk, "TILE GENERATION");
+		const TVertex& v0 = vertices[indices[0] - draw.minVertex];
+		const TVertex& v1 = vertices[indices[1] - draw.minVertex];
+		const TVertex& v2 = vertices[indices[2] - draw.minVertex];
 
-	clk = BEGIN_BENCH;
-	#pragma omp parallel for schedule(dynamic)
-	for (int i = 0; i < tiles.size(); i++) {
-		TTile tile = tiles[i];
-		drawTile(tile);
+		if (!triangleProcess(v0, v1, v2, polygon)) {
+			continue;
+		}
+
+		for (int i = 1; i < polygon.count - 1; i++) {
+			const TVertex& vt0 = polygon.vertices[0];
+			const TVertex& vt1 = polygon.vertices[i];
+			const TVertex& vt2 = polygon.vertices[i + 1];
+
+			std::optional<TTriangle> optTri = createTriangle(vt0, vt1, vt2, eye);
+			if (optTri.has_value()) {
+				optTri->draw = d;
+				triangles.push_back(optTri.value());
+			}
+		}
 	}
-	END_BENCH(clk, "RENDERING");
-}
\ No newline at end of file
+}
+
+/// Places the chunks one after the other, keeping triangles in submission order
+void GFX::placeChunks() {
+	m_chunkStart[0] = 0;
+	for (int c = 0; c < m_numChunks; c++) {
+		m_chunkStart[c + 1] = m_chunkStart[c] + int(m_chunkTriangles[c].size());
+	}
+	m_triangles.resize(m_chunkStart[m_numChunks]);
+}
+
+void GFX::mergeChunk(int c) {
+	std::copy(m_chunkTriangles[c].begin(), m_chunkTriangles[c].end(), m_triangles.begin() + m_chunkStart[c]);
+}
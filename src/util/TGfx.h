@@ -2,25 +2,63 @@
 #define T_GFX_H
 
 #include <string>
+#include <algorithm>
 #include <optional>
 #include <array>
 #include <vector>
 #include <chrono>
 
-#include "SDL2/SDL.h"
 #include "vec3.hpp"
 #include "mat4x4.hpp"
 #include "gtc/matrix_transform.hpp"
 
 #include "TMatrixStack.h"
+#include "TRasterKernels.h"
+#include "TJobSystem.h"
 #include "../data/TStructs.h"
 #include "../data/TFrameBuffer.h"
 
-#include "concurrentqueue.h"
+class TWindow;
+class GFX;
 
 #define T_MAX_MATRIX_TACK_DEPTH 128
+
+/// Default side of the square screen tiles, see GFX::tileSize()
 #define T_TILE_SIZE 16
 
+/// Largest tile side. Keeps the Hi-Z blocks of a tile within a 64-bit mask
+/// and its fixed-point edge stepping within 32 bits.
+#define T_MAX_TILE_SIZE 64
+
+/// Frames timed per candidate tile size when auto-tuning
+#define T_TILE_TUNE_FRAMES 8
+
+/// Vertices shaded per job of the vertex stage
+#define T_JOB_VERTICES 1024
+
+/// Estimated cost of a triangle in a tile beyond its pixels, in pixels
+#define T_TILE_TRIANGLE_COST 16
+
+/// Tiles costing more than 1 / (T_TILE_SPLIT_SHARE * threads) of the whole
+/// raster pass are split into sub-tiles before scheduling
+#define T_TILE_SPLIT_SHARE 4
+
+/// Side, in tiles, of the tile blocks that triangles spanning more than one
+/// block are first tested against during binning
+#define T_BIN_BLOCK 4
+
+/// Screen-space extent, in pixels, triangles may span before they get clipped
+/// against the left, right, top and bottom planes. Inside of it the tile
+/// grid scissors them instead. Set to 0 to always clip against all 6 planes.
+#define T_GUARD_BAND 4096
+
+/// Recorded triangles after which a deferred mesh() submits on its own, so
+/// the per-submit buffers stay small enough to be cache friendly
+#define T_DEFERRED_TRIANGLE_BUDGET 65536
+
+/// A triangle clipped by the 6 frustum planes has at most 3 + 6 vertices
+#define T_MAX_CLIP_VERTICES 9
+
 #ifndef NDEBUG
 #define BEGIN_BENCH std::chrono::high_resolution_clock::now()
 #define END_BENCH(clk, name) std::cout << "RUNTIME OF " << name << ": " << \
@@ -32,9 +70,100 @@
 #define END_BENCH
 #endif
 
+enum class TRasterMode {
+	EdgeFunction, // Per-triangle setup, incremental edge stepping
+	Barycentric // Reference path, recomputes barycentrics per pixel
+};
+
+enum class TDepthMode {
+	TestWrite, // Pixels closer than the stored depth pass and write theirs
+	Test, // Pixels closer than the stored depth pass, depth is read-only
+	Off // Every pixel passes, depth is untouched
+};
+
+enum class TBlendMode {
+	Alpha, // src * src.a + dst * (1 - src.a)
+	Opaque, // src
+	Additive // dst + src * src.a
+};
+
+/// Render state captured by mesh(). Immutable once recorded, consecutive
+/// draws with the same state share one block.
+struct TDrawState {
+	TShader* shader;
+	TTexture* texture;
+	TFrameBuffer* target;
+	TDepthMode depthMode;
+	TBlendMode blendMode;
+	TRasterMode rasterMode;
+	TRowKernel rowKernel, coveredRowKernel;
+
+	bool operator==(const TDrawState& o) const {
+		return shader == o.shader && texture == o.texture && target == o.target &&
+			depthMode == o.depthMode && blendMode == o.blendMode &&
+			rasterMode == o.rasterMode && rowKernel == o.rowKernel &&
+			coveredRowKernel == o.coveredRowKernel;
+	}
+};
+
+/// Pixels of one triangle waiting for the pixel shader
+struct TPixelBatch {
+	TPixelInput inputs[T_PIXEL_BATCH];
+	int x[T_PIXEL_BATCH], y[T_PIXEL_BATCH];
+	float z[T_PIXEL_BATCH];
+	int count;
+
+	/// Texture coordinate derivatives of the 2x2 quads of the triangle, slot
+	/// (x / 2) % (T_MAX_TILE_SIZE / 2) holds quad row quadRow (-1 when empty)
+	glm::vec2 quadDx[T_MAX_TILE_SIZE / 2], quadDy[T_MAX_TILE_SIZE / 2];
+	int quadRow[T_MAX_TILE_SIZE / 2];
+
+	void clearQuads() { std::fill(quadRow, quadRow + T_MAX_TILE_SIZE / 2, -1); }
+};
+
+/// A screen tile, references its triangles by index through the range
+/// [first, first + count) of the per-frame bin array. Sub-tiles of a split
+/// tile share its range.
 struct TTile {
 	int x, y;
-	std::vector<TTriangle> triangles;
+	int width, height; // Clipped to the screen on the right and bottom edges
+	int first, count;
+	int64_t cost; // Estimated raster work, in pixels
+};
+
+struct TClipPolygon {
+	std::array<TVertex, T_MAX_CLIP_VERTICES> vertices;
+	int count;
+};
+
+/// A recorded mesh() call. The vertex and index arrays are referenced, not
+/// copied, the rest of the state lives in the draw's state block.
+struct TDrawCommand {
+	const std::vector<TVertex>* vertices;
+	const std::vector<int>* indices;
+	glm::mat4 projection, modelView;
+	int state; // Index of the draw's TDrawState in the per-submit blocks
+
+	/// Range of vertices the indices reference, only those are shaded
+	int minVertex, vertexCount;
+
+	/// First vertex and triangle of the draw in the per-submit buffers
+	int firstVertex, firstTriangle;
+
+	/// Pipeline stages instantiated for the shader type given to mesh()
+	void (*shadeVertices)(GFX& gfx, const TDrawCommand& draw, int begin, int end);
+	void (*drawTriangles)(GFX& gfx, const TTile& tile, const TDrawCommand& draw, const int* triangleIDs, int count);
+};
+
+/// Counters accumulated since the last clear()
+struct TRenderStats {
+	int vertices; // Vertices run through the vertex shader
+	int triangles; // Triangles left after clipping and culling
+	int binnedTriangles; // Triangle references over all tiles
+	int tiles; // Non-empty tiles
+	size_t binBytes; // Bytes written by binning (records, indices and tiles)
+	int hiZRejected; // Triangle references dropped by hierarchical Z at binning
+	int splitTiles; // Tiles split into sub-tiles to balance the raster pass
 };
 
 class GFX {
@@ -42,13 +171,32 @@ public:
 	GFX() {}
 	virtual ~GFX() {}
 
+	/// Windowed GFX. Returns nothing when the window can't be created, when
+	/// the downscaled size is empty, or when built without TRENDER_WINDOW.
 	static std::optional<GFX> create(const std::string title, int width, int height, float downScale=1.0f);
+
+	/// Offscreen GFX, renders into the default target only. Doesn't open a
+	/// window or touch SDL; flip() and poll() do nothing.
+	static std::optional<GFX> createHeadless(int width, int height);
 	void destroy();
 
+	bool headless() const { return m_window == nullptr; }
 	bool shouldClose() const { return m_shouldClose; }
+
+	/// Shows the default target. When frame pipelining is on (the default for
+	/// windowed GFX) this only queues the frame: it's converted by the present
+	/// thread while the next one renders, and it reaches the screen on the
+	/// next flip(). The default target then swaps to the second framebuffer,
+	/// which still holds the frame before the queued one.
 	void flip();
+	bool framePipelining() const { return m_framePipelining; }
+	void framePipelining(bool enabled);
+
 	void poll();
-	double time() const { return double(SDL_GetTicks()) / 1000.0; }
+	double time() const;
+
+	/// Reads the current target back as 8-bit RGBA, row 0 first
+	void readPixels(std::vector<uint8_t>& out);
 
 	/// Drawing Functions
 	void clear(glm::vec3 color = { 0.0f, 0.0f, 0.0f });
@@ -58,6 +206,27 @@ public:
 	/// 3D drawing
 	void mesh(const std::vector<TVertex>& vertices, const std::vector<int>& indices);
 
+	/// Draws with a raster loop specialized for ShaderT. When ShaderT is final
+	/// its vertex() and pixel() are called directly instead of through the
+	/// vtable; other types are dispatched virtually, since 'shader' may be a
+	/// subclass. The overload above is the same pipeline for TShader.
+	template <typename ShaderT>
+	void mesh(ShaderT& shader, const std::vector<TVertex>& vertices, const std::vector<int>& indices);
+
+	/// In deferred mode mesh() only records the draw with the current state
+	/// (bound texture, target, modes and matrices), and submit() transforms,
+	/// bins and rasterizes all recorded draws in one pass, in submission
+	/// order. The shader, vertices and indices must stay alive and unchanged
+	/// until then. Batches larger than T_DEFERRED_TRIANGLE_BUDGET are
+	/// submitted early; clear(), pixel(), line(), flip() and readPixels()
+	/// submit pending draws first, so they see them drawn. So does mesh()
+	/// when its bound texture is the target of a pending draw, or its target
+	/// is the bound texture of one. Textures a shader samples on its own
+	/// aren't tracked, submit() before rendering to them.
+	bool deferred() const { return m_deferred; }
+	void deferred(bool enabled);
+	void submit();
+
 	TMatrixStack& modelView() { return m_modelMatrixStack; }
 	TMatrixStack& projection() { return m_projectionMatrixStack; }
 
@@ -79,34 +248,152 @@ public:
 	}
 	void boundShader(TShader* shader) { m_boundShader = shader; }
 
+	TRasterMode rasterMode() const { return m_rasterMode; }
+	void rasterMode(TRasterMode mode) { m_rasterMode = mode; }
+
+	TDepthMode depthMode() const { return m_depthMode; }
+	void depthMode(TDepthMode mode) { m_depthMode = mode; }
+
+	TBlendMode blendMode() const { return m_blendMode; }
+	void blendMode(TBlendMode mode) { m_blendMode = mode; }
+
+	/// SIMD width of the edge-function row kernel. Defaults to the best level
+	/// the CPU supports; requesting an unsupported level falls back to it.
+	TSimdLevel simdLevel() const { return m_simdLevel; }
+	void simdLevel(TSimdLevel level);
+
+	/// Side of the screen tiles in pixels, a multiple of T_HIZ_BLOCK up to
+	/// T_MAX_TILE_SIZE (other sizes are rounded down and clamped). Setting it
+	/// stops auto-tuning.
+	int tileSize() const { return m_tileSize; }
+	void tileSize(int size);
+
+	/// Auto-tuning tries tiles of 8, 16, 32 and 64 pixels, each for
+	/// T_TILE_TUNE_FRAMES frames that draw something, and keeps the size with
+	/// the fastest submit() time per frame. Frames end on flip(). The pick is
+	/// in tileSize() once tileAutoTune() turns false again.
+	bool tileAutoTune() const { return m_tileTuneIndex >= 0; }
+	void tileAutoTune(bool enabled);
+
+	/// Threads that run submit(): the job system's workers and the thread
+	/// calling it, which works along. 0 uses one per hardware thread, the
+	/// default.
+	int threads() const { return m_jobs->threads(); }
+	void threads(int count);
+
+	/// CPUs the worker threads are pinned to, worker i runs on
+	/// cpus[i % cpus.size()]. Empty, the default, leaves it to the OS. Only
+	/// applied on Linux.
+	const std::vector<int>& threadAffinity() const { return m_threadAffinity; }
+	void threadAffinity(const std::vector<int>& cpus);
+
+	const TRenderStats& stats() const { return m_stats; }
+
 private:
 	bool m_shouldClose;
 
-	int m_windowWidth, m_windowHeight,
-		m_drawWidth, m_drawHeight;
+	int m_drawWidth, m_drawHeight;
 
-	SDL_Event m_event;
-	SDL_Window* m_window;
-	SDL_Renderer* m_renderer;
-	SDL_Texture* m_screenBuffer;
+	TWindow* m_window;
+	std::chrono::steady_clock::time_point m_startTime;
 
 	TTexture* m_boundTexture;
 	TShader* m_boundShader;
 
+	TRasterMode m_rasterMode;
+	TDepthMode m_depthMode;
+	TBlendMode m_blendMode;
+	TSimdLevel m_simdLevel;
+	TRowKernel m_rowKernel, m_coveredRowKernel;
+
 	TFrameBuffer* m_defaultTarget;
+	TFrameBuffer* m_presentTarget; // Default target queued for presentation
 	TFrameBuffer* m_target;
+	bool m_framePipelining;
 
 	TMatrixStack m_modelMatrixStack, m_projectionMatrixStack;
 	glm::mat4 m_viewportMatrix;
 
-	std::vector<TAABB> m_screenTiles;
+	/// Guard band size in NDC units (>= 1)
+	float m_guardBand;
+
+	int m_tileSize;
+
+	/// Auto-tuning: candidate being timed (-1 when off), its timed frames and
+	/// the best frame time of every candidate, in seconds
+	int m_tileTuneIndex, m_tileTuneFrame;
+	std::array<double, 4> m_tileTuneTimes;
+
+	/// Time spent in submit() since the last flip(), in seconds
+	double m_frameTime;
+
+	TJobSystem* m_jobs;
+	std::vector<int> m_threadAffinity;
+
+	bool m_deferred;
+	std::vector<TDrawCommand> m_draws;
+	std::vector<TDrawState> m_states;
+	int m_recordedTriangles;
+
+	/// Post-transform vertex buffer of the draws being submitted
+	std::vector<TVertex> m_transformed;
+
+	/// Per-frame triangle records, bins and tiles (kept to reuse their storage)
+	std::vector<TTriangle> m_triangles;
+	std::vector<int> m_binTriangles;
+	std::vector<TTile> m_tiles;
+
+	/// Binning state of the submit, per chunk of triangles and per block of
+	/// tiles (kept to reuse their storage)
+	int m_tilesX, m_tilesY, m_numChunks, m_numBlocks;
+	std::vector<std::vector<TTriangle>> m_chunkTriangles;
+	std::vector<int> m_chunkStart, m_chunkRejected;
+	std::vector<int> m_binOffsets; // Per chunk, per tile
+	std::vector<int> m_tileStart, m_tileCount, m_blockStart;
+
+	TRenderStats m_stats;
 
 	static TShader* g_defaultShader;
 
+	template <typename ShaderT>
+	static void shadeVertices(GFX& gfx, const TDrawCommand& draw, int begin, int end);
+
+	template <typename ShaderT>
+	static void drawTriangles(GFX& gfx, const TTile& tile, const TDrawCommand& draw, const int* triangleIDs, int count);
+
+	static void setupPixel(const TDrawState& state, const TTriangle& tri, const glm::vec3& bc, TPixelInput& pi);
+	static void quadDerivatives(TPixelBatch& batch, const TTriangle& tri, int x, int y, TPixelInput& pi);
+
+	template <typename ShaderT>
+	static void queuePixel(ShaderT& shader, const TDrawState& state, TPixelBatch& batch, const TTriangle& tri, int x, int y, const glm::vec3& bc, float z);
+
+	template <typename ShaderT>
+	static void shadeBatch(ShaderT& shader, const TDrawState& state, TPixelBatch& batch);
+	static void blendPixel(TTexture* color, int x, int y, const glm::vec4& src, TBlendMode mode);
+
 	void drawTile(const TTile& tile);
-	std::optional<TTriangle> createTriangle(const TVertex& v0, const TVertex& v1, const TVertex& v2);
-	std::vector<TTile> buildTiles(const std::vector<TTriangle>& tris);
-	std::vector<TVertex> triangleProcess(const TVertex& v0, const TVertex& v1, const TVertex& v2);
+	void assembleChunk(int c, int begin, int end);
+	void placeChunks();
+	void mergeChunk(int c);
+	std::optional<TTriangle> createTriangle(const TVertex& v0, const TVertex& v1, const TVertex& v2, const glm::vec3& eye);
+	void tileBounds(const TTriangle& tri, glm::ivec2& tmin, glm::ivec2& tmax) const;
+	TCoverage tileCoverage(const TTriangle& tri, int tx0, int ty0, int tx1, int ty1) const;
+	template <typename VisitT>
+	void forEachTile(const TTriangle& tri, VisitT&& visit) const;
+	bool occluded(const TTriangle& tri, int tx, int ty) const;
+
+	void countChunk(int c);
+	void sumTiles(int b);
+	void prefixBlocks();
+	void offsetTiles(int b);
+	void scatterChunk(int c);
+	void collectTiles();
+	int64_t tileCost(const TTile& tile) const;
+	void scheduleTiles();
+	void tuneTileSize();
+	bool triangleProcess(const TVertex& v0, const TVertex& v1, const TVertex& v2, TClipPolygon& out);
 };
 
+#include "TGfx.inl"
+
 #endif // T_GFX_H
\ No newline at end of file
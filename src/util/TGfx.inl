@@ -0,0 +1,393 @@
+/// Template implementations of the GFX raster pipeline, included by TGfx.h
+
+#include <iostream>
+#include <limits>
+#include <type_traits>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/// Shaders whose stages can be called directly (no virtual dispatch, so they
+/// can be inlined). Only a final ShaderT is surely the dynamic type, a shader
+/// passed as one of its bases still goes through the vtable.
+template <typename ShaderT>
+inline constexpr bool tDirectShader = std::is_final_v<ShaderT>;
+
+template <typename ShaderT>
+inline TVertex tShadeVertex(ShaderT& shader, const glm::mat4& projection, const glm::mat4& viewModel, const TVertex& v) {
+	if constexpr (!tDirectShader<ShaderT>) {
+		return shader.vertex(projection, viewModel, v);
+	} else {
+		return shader.ShaderT::vertex(projection, viewModel, v);
+	}
+}
+
+/// Shaders without their own pixels() get the default lane loop written out
+/// here, so it can call their pixel() directly too.
+template <typename ShaderT>
+inline void tShadePixels(ShaderT& shader, const TPixelInput* in, glm::vec4* out, int count, uint32_t& mask) {
+	if constexpr (!tDirectShader<ShaderT>) {
+		shader.pixels(in, out, count, mask);
+	} else if constexpr (std::is_same_v<decltype(&ShaderT::pixels), decltype(&TShader::pixels)>) {
+		for (int i = 0; i < count; i++) {
+			if (mask & (1u << i)) {
+				out[i] = shader.ShaderT::pixel(in[i]);
+				if (in[i].discarded) {
+					mask &= ~(1u << i);
+				}
+			}
+		}
+	} else {
+		shader.ShaderT::pixels(in, out, count, mask);
+	}
+}
+
+inline int tCountTrailingZeros(uint64_t v) {
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward64(&i, v);
+	return int(i);
+#else
+	return __builtin_ctzll(v);
+#endif
+}
+
+inline int tCountLeadingZeros(uint64_t v) {
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanReverse64(&i, v);
+	return 63 - int(i);
+#else
+	return __builtin_clzll(v);
+#endif
+}
+
+inline float tWrap(float flt, float max) {
+	if (flt > max) {
+		flt -= max;
+	}
+	if (flt < 0.0f) {
+		flt += max;
+	}
+	return flt;
+}
+
+inline glm::vec3 tBarycentric(
+	const glm::vec2& p,
+	const glm::vec4& v0,
+	const glm::vec4& v1,
+	const glm::vec4& v2
+) {
+	glm::vec4 ab = v1 - v0;
+	glm::vec4 ac = v2 - v0;
+	glm::vec2 pa = glm::vec2(v0.x, v0.y) - p;
+
+	glm::vec3 uv1 = glm::cross(glm::vec3(ac.x, ab.x, pa.x), glm::vec3(ac.y, ab.y, pa.y));
+
+	if (uv1.z == 0.0f) {
+		return glm::vec3(-1, 1, 1);
+	}
+	return (1.0f / uv1.z) * glm::vec3(uv1.z - (uv1.x + uv1.y), uv1.y, uv1.x);
+}
+
+/// Perspective-correct texture coordinates at the barycentric weights 'bc'
+inline glm::vec2 tTexCoords(const TTriangle& tri, const glm::vec3& bc) {
+	glm::vec3 P = glm::vec3(
+		bc.x / tri.vp0.w,
+		bc.y / tri.vp1.w,
+		bc.z / tri.vp2.w
+	);
+	P = (1.0f / (P.x + P.y + P.z)) * P;
+	return P.x * tri.v0.uv + P.y * tri.v1.uv + P.z * tri.v2.uv;
+}
+
+template <typename ShaderT>
+void GFX::mesh(ShaderT& shader, const std::vector<TVertex>& vertices, const std::vector<int>& indices) {
+	TDrawState state;
+	state.shader = &shader;
+	state.texture = m_boundTexture;
+	state.target = target();
+	state.depthMode = m_depthMode;
+	state.blendMode = m_blendMode;
+	state.rasterMode = m_rasterMode;
+	state.rowKernel = m_rowKernel;
+	state.coveredRowKernel = m_coveredRowKernel;
+
+	/// The tiles of a submit run in any order, so a draw can't sample a
+	/// texture that pending draws render to, or render to one they sample
+	for (const TDrawState& pending : m_states) {
+		if ((state.texture != nullptr && state.texture == pending.target->texture()) ||
+			(pending.texture != nullptr && pending.texture == state.target->texture())) {
+			submit();
+			break;
+		}
+	}
+
+	if (m_states.empty() || !(m_states.back() == state)) {
+		m_states.push_back(state);
+	}
+
+	TDrawCommand draw;
+	draw.vertices = &vertices;
+	draw.indices = &indices;
+	draw.state = int(m_states.size()) - 1;
+	draw.projection = projection().matrix();
+	draw.modelView = modelView().matrix();
+	draw.firstVertex = 0;
+	draw.firstTriangle = 0;
+
+	const size_t numIndices = indices.size() / 3 * 3;
+	if (numIndices > 0) {
+		const auto range = std::minmax_element(indices.begin(), indices.begin() + numIndices);
+		draw.minVertex = *range.first;
+		draw.vertexCount = *range.second - *range.first + 1;
+	} else {
+		draw.minVertex = 0;
+		draw.vertexCount = 0;
+	}
+
+	draw.shadeVertices = &GFX::shadeVertices<ShaderT>;
+	draw.drawTriangles = &GFX::drawTriangles<ShaderT>;
+	m_draws.push_back(draw);
+	m_recordedTriangles += int(indices.size() / 3);
+
+	if (!m_deferred || m_recordedTriangles >= T_DEFERRED_TRIANGLE_BUDGET) {
+		submit();
+	}
+}
+
+/// Vertex stage of one draw, shades the vertices [begin, end) of its
+/// referenced range once each into the transformed buffer. Draws write
+/// disjoint ranges.
+template <typename ShaderT>
+void GFX::shadeVertices(GFX& gfx, const TDrawCommand& draw, int begin, int end) {
+	ShaderT& shader = static_cast<ShaderT&>(*gfx.m_states[draw.state].shader);
+	const TVertex* vertices = &(*draw.vertices)[draw.minVertex];
+	TVertex* out = &gfx.m_transformed[draw.firstVertex];
+
+	for (int i = begin; i < end; i++) {
+		out[i] = tShadeVertex(shader, draw.projection, draw.modelView, vertices[i]);
+	}
+}
+
+inline void GFX::blendPixel(TTexture* color, int x, int y, const glm::vec4& src, TBlendMode mode) {
+	glm::vec4& dst = color->m_pixels[color->texelIndex(x, y, color->m_levels[0])];
+	switch (mode) {
+		case TBlendMode::Alpha: dst = glm::mix(dst, src, src.a); break;
+		case TBlendMode::Opaque: dst = src; break;
+		case TBlendMode::Additive: dst = glm::min(dst + src * src.a, 1.0f); break;
+	}
+}
+
+/// Interpolates the varyings of 'tri' at the barycentric weights 'bc' into 'pi'
+inline void GFX::setupPixel(const TDrawState& state, const TTriangle& tri, const glm::vec3& bc, TPixelInput& pi) {
+	glm::vec3 P = glm::vec3(
+		bc.x / tri.vp0.w,
+		bc.y / tri.vp1.w,
+		bc.z / tri.vp2.w
+	);
+	P = (1.0f / (P.x + P.y + P.z)) * P;
+
+	glm::vec4 col = P.x * tri.v0.color + P.y * tri.v1.color + P.z * tri.v2.color;
+	glm::vec2 uv = P.x * tri.v0.uv + P.y * tri.v1.uv + P.z * tri.v2.uv;
+	uv.x = tWrap(uv.x, 1.0f);
+	uv.y = tWrap(uv.y, 1.0f);
+
+	pi.boundTexture = state.texture;
+	pi.vertexPositions = P.x * tri.vp0 + P.y * tri.vp1 + P.z * tri.vp2;
+	pi.normals = glm::normalize(P.x * tri.v0.normal + P.y * tri.v1.normal + P.z * tri.v2.normal);
+	pi.texCoords = uv;
+	pi.vertexColors = col;
+	pi.discarded = false;
+}
+
+/// Texture coordinate derivatives of the 2x2 quad of pixel (x, y), evaluated
+/// by the first pixel of the quad that's queued and reused by the others.
+/// Quads are at most T_MAX_TILE_SIZE / 2 apart in a tile, so slots don't clash.
+inline void GFX::quadDerivatives(TPixelBatch& batch, const TTriangle& tri, int x, int y, TPixelInput& pi) {
+	const int slot = (x >> 1) & (T_MAX_TILE_SIZE / 2 - 1);
+	if (batch.quadRow[slot] != (y >> 1)) {
+		const glm::vec2 quad(x & ~1, y & ~1);
+		const glm::vec3 bcQuad = tri.edgeA * quad.x + tri.edgeB * quad.y + tri.edgeC;
+		const glm::vec2 uvQuad = tTexCoords(tri, bcQuad);
+
+		batch.quadDx[slot] = tTexCoords(tri, bcQuad + tri.edgeA) - uvQuad;
+		batch.quadDy[slot] = tTexCoords(tri, bcQuad + tri.edgeB) - uvQuad;
+		batch.quadRow[slot] = y >> 1;
+	}
+	pi.texCoordsDx = batch.quadDx[slot];
+	pi.texCoordsDy = batch.quadDy[slot];
+}
+
+/// Adds a pixel that passed the depth test to the batch, shades it when full
+template <typename ShaderT>
+void GFX::queuePixel(ShaderT& shader, const TDrawState& state, TPixelBatch& batch, const TTriangle& tri, int x, int y, const glm::vec3& bc, float z) {
+	const int i = batch.count++;
+	setupPixel(state, tri, bc, batch.inputs[i]);
+	quadDerivatives(batch, tri, x, y, batch.inputs[i]);
+	batch.x[i] = x;
+	batch.y[i] = y;
+	batch.z[i] = z;
+
+	if (batch.count == T_PIXEL_BATCH) {
+		shadeBatch(shader, state, batch);
+	}
+}
+
+/// Runs the pixel shader over the batch and writes the lanes it kept
+template <typename ShaderT>
+void GFX::shadeBatch(ShaderT& shader, const TDrawState& state, TPixelBatch& batch) {
+	glm::vec4 colors[T_PIXEL_BATCH];
+	uint32_t mask = (1u << batch.count) - 1;
+	tShadePixels(shader, batch.inputs, colors, batch.count, mask);
+
+	TTexture* color = state.target->texture();
+	for (int i = 0; i < batch.count; i++) {
+		if (mask & (1u << i)) {
+			blendPixel(color, batch.x[i], batch.y[i], glm::clamp(colors[i], 0.0f, 1.0f), state.blendMode);
+			if (state.depthMode == TDepthMode::TestWrite) {
+				state.target->depthRow(batch.y[i])[batch.x[i]] = batch.z[i];
+				state.target->invalidateHiZ(batch.x[i], batch.y[i]);
+			}
+		}
+	}
+	batch.count = 0;
+}
+
+/// Rasterizes 'count' triangles of one draw that overlap 'tile'
+template <typename ShaderT>
+void GFX::drawTriangles(GFX& gfx, const TTile& tile, const TDrawCommand& draw, const int* triangleIDs, int count) {
+	const TDrawState& state = gfx.m_states[draw.state];
+	ShaderT& shader = static_cast<ShaderT&>(*state.shader);
+	TFrameBuffer* target = state.target;
+	const bool depthTest = state.depthMode != TDepthMode::Off;
+
+	const int tileW = std::min(tile.width, target->width() - tile.x);
+	const int tileH = std::min(tile.height, target->height() - tile.y);
+	if (tileW <= 0 || tileH <= 0) {
+		return;
+	}
+
+	/// Pixels of one triangle are batched, a triangle is fully written
+	/// before the next one is depth tested
+	TPixelBatch batch;
+	batch.count = 0;
+
+	if (state.rasterMode == TRasterMode::Barycentric) {
+		for (int i = 0; i < count; i++) {
+			const TTriangle& tri = gfx.m_triangles[triangleIDs[i]];
+			batch.clearQuads();
+			for (int y = tile.y; y < tile.y + tileH; y++) {
+				for (int x = tile.x; x < tile.x + tileW; x++) {
+					glm::vec3 bc = tBarycentric(
+						glm::vec2(x, y),
+						tri.v0.position,
+						tri.v1.position,
+						tri.v2.position
+					);
+
+					if (bc.x < 0.0f || bc.y < 0.0f || bc.z < 0.0f) { continue; }
+
+					float z = (bc.x / tri.vp0.w + bc.y / tri.vp1.w + bc.z / tri.vp2.w) / 3.0f;
+					if (!depthTest || target->depth(x, y) < z) {
+						queuePixel(shader, state, batch, tri, x, y, bc, z);
+					}
+				}
+			}
+			if (batch.count > 0) {
+				shadeBatch(shader, state, batch);
+			}
+		}
+		return;
+	}
+
+	float rowZ[T_MAX_TILE_SIZE];
+
+	/// Stands in for the depth row when the test is off, everything passes
+	float noDepth[T_MAX_TILE_SIZE];
+	std::fill(noDepth, noDepth + T_MAX_TILE_SIZE, std::numeric_limits<float>::lowest());
+
+	/// Hierarchical Z blocks of the tile, bit bx + by * blocksW of 'live'
+	const int bx0 = tile.x / T_HIZ_BLOCK, by0 = tile.y / T_HIZ_BLOCK;
+	const int blocksW = (tileW + T_HIZ_BLOCK - 1) / T_HIZ_BLOCK;
+	const int blocksH = (tileH + T_HIZ_BLOCK - 1) / T_HIZ_BLOCK;
+	const uint64_t rowBlocks = (uint64_t(1) << blocksW) - 1;
+
+	for (int t = 0; t < count; t++) {
+		const TTriangle& tri = gfx.m_triangles[triangleIDs[t]];
+
+		/// Tiles inside the triangle go through the kernel without coverage tests
+		const TCoverage coverage = tri.coverage(tile.x, tile.y, tile.x + tileW - 1, tile.y + tileH - 1);
+		if (coverage == TCoverage::None) {
+			continue;
+		}
+		const TRowKernel kernel = coverage == TCoverage::Full ? state.coveredRowKernel : state.rowKernel;
+
+		/// Drop the blocks where the triangle is behind every stored pixel
+		uint64_t live = ~uint64_t(0);
+		if (depthTest) {
+			live = 0;
+			for (int by = 0; by < blocksH; by++) {
+				for (int bx = 0; bx < blocksW; bx++) {
+					if (target->hiZ(bx0 + bx, by0 + by) < tri.maxZ) {
+						live |= uint64_t(1) << (bx + by * blocksW);
+					}
+				}
+			}
+			if (live == 0) {
+				continue;
+			}
+		}
+
+		batch.clearQuads();
+
+		TRowSpan span;
+		span.step = tri.edgeA;
+		span.invW = glm::vec3(1.0f / tri.vp0.w, 1.0f / tri.vp1.w, 1.0f / tri.vp2.w);
+
+		/// Fixed-point edge functions at the tile origin. They change by less
+		/// than 2^28 over a tile of T_MAX_TILE_SIZE, so one beyond +-2^30 keeps its sign over all
+		/// of it and can be clamped to make the stepping fit in 32 bits.
+		int32_t edgeTile[3];
+		for (int k = 0; k < 3; k++) {
+			const int64_t e = int64_t(tri.fixedA[k]) * tile.x + int64_t(tri.fixedB[k]) * tile.y + tri.fixedC[k];
+			edgeTile[k] = int32_t(std::max<int64_t>(-(int64_t(1) << 30), std::min<int64_t>(e, int64_t(1) << 30)));
+			span.edgeStep[k] = tri.fixedA[k];
+		}
+
+		for (int y = tile.y; y < tile.y + tileH; y++) {
+			/// Only the span between the first and last live block of the row
+			const uint64_t rowLive = (live >> (((y - tile.y) / T_HIZ_BLOCK) * blocksW)) & rowBlocks;
+			if (rowLive == 0) {
+				continue;
+			}
+			const int x0 = tCountTrailingZeros(rowLive) * T_HIZ_BLOCK;
+			const int x1 = std::min(tileW, (63 - tCountLeadingZeros(rowLive) + 1) * T_HIZ_BLOCK);
+
+			/// Weights from the screen position alone, not the tile origin, so
+			/// the depth of a pixel doesn't depend on the tile size
+			span.x = tile.x + x0;
+			span.bc = tri.edgeB * float(y) + tri.edgeC;
+			for (int k = 0; k < 3; k++) {
+				span.edge[k] = edgeTile[k] + tri.fixedB[k] * (y - tile.y) + tri.fixedA[k] * x0;
+			}
+
+			const float* depth = depthTest ? target->depthRow(y) + tile.x + x0 : noDepth;
+			uint64_t mask = kernel(span, depth, x1 - x0, rowZ);
+			for (int i = 0; mask != 0; i++, mask >>= 1) {
+				if (mask & 1) {
+					queuePixel(shader, state, batch, tri, tile.x + x0 + i, y, tSpanWeights(span, i), rowZ[i]);
+				}
+			}
+		}
+		if (batch.count > 0) {
+			shadeBatch(shader, state, batch);
+		}
+	}
+
+	// line(tile.x, tile.y, tile.x+tile.width, tile.y, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
+	// line(tile.x+tile.width, tile.y, tile.x+tile.width, tile.y+tile.height, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
+	// line(tile.x, tile.y+tile.height, tile.x+tile.width, tile.y+tile.height, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
+	// line(tile.x, tile.y, tile.x, tile.y+tile.height, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
+}
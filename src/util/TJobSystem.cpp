@@ -0,0 +1,220 @@
+#include "TJobSystem.h"
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/// Queue of the current thread, for the job system it works for
+static thread_local const TJobSystem* t_jobSystem = nullptr;
+static thread_local int t_jobQueue = 0;
+
+static void pinThread(std::thread& thread, int cpu) {
+#if defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+	(void) thread;
+	(void) cpu;
+#endif
+}
+
+int TTaskGraph::add(TTaskFunc fn, int count) {
+	m_tasks.emplace_back();
+	TTask& task = m_tasks.back();
+	task.fn = std::move(fn);
+	task.count = count;
+	task.dependencies = 0;
+	return int(m_tasks.size()) - 1;
+}
+
+void TTaskGraph::after(int task, int dependency) {
+	m_tasks[dependency].dependents.push_back(task);
+	m_tasks[task].dependencies++;
+}
+
+TJobSystem::TJobSystem(int threads, const std::vector<int>& cpus) {
+	const int count = threads > 0 ? threads : std::max(1, int(std::thread::hardware_concurrency()));
+
+	m_queues = std::vector<TJobQueue>(count);
+	m_queued = 0;
+	m_quit = false;
+
+	for (int i = 1; i < count; i++) {
+		m_workers.emplace_back(&TJobSystem::workerLoop, this, i);
+		if (!cpus.empty()) {
+			pinThread(m_workers.back(), cpus[(i - 1) % cpus.size()]);
+		}
+	}
+}
+
+TJobSystem::~TJobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(m_sleepLock);
+		m_quit = true;
+	}
+	m_sleepSignal.notify_all();
+
+	for (std::thread& worker : m_workers) {
+		worker.join();
+	}
+}
+
+void TJobSystem::run(TTaskGraph& graph) {
+	if (graph.m_tasks.empty()) {
+		return;
+	}
+
+	/// Every counter is set before the first task starts, tasks without
+	/// dependencies may finish and release others right away
+	graph.m_unfinished = graph.size();
+	graph.m_jobs = 0;
+	for (TTaskGraph::TTask& task : graph.m_tasks) {
+		task.pending = task.dependencies;
+	}
+	for (int i = 0; i < graph.size(); i++) {
+		if (graph.m_tasks[i].dependencies == 0) {
+			release(graph, i);
+		}
+	}
+
+	const int queue = currentQueue();
+	auto done = [&] { return graph.m_unfinished.load() == 0 && graph.m_jobs.load() == 0; };
+	while (!done()) {
+		TJob job;
+		if (pop(queue, job) || steal(queue, job)) {
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepLock);
+		m_sleepSignal.wait(lock, [&] { return m_queued.load() > 0 || done(); });
+	}
+}
+
+void TJobSystem::parallelFor(int count, const TTaskGraph::TTaskFunc& fn) {
+	TTaskGraph graph;
+	graph.add(fn, count);
+	run(graph);
+}
+
+void TJobSystem::workerLoop(int queue) {
+	t_jobSystem = this;
+	t_jobQueue = queue;
+
+	while (true) {
+		TJob job;
+		if (pop(queue, job) || steal(queue, job)) {
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepLock);
+		m_sleepSignal.wait(lock, [&] { return m_quit || m_queued.load() > 0; });
+		if (m_quit) {
+			return;
+		}
+	}
+}
+
+int TJobSystem::currentQueue() const {
+	return t_jobSystem == this ? t_jobQueue : 0;
+}
+
+/// Newest job of the thread's own queue
+bool TJobSystem::pop(int queue, TJob& job) {
+	TJobQueue& q = m_queues[queue];
+	std::lock_guard<std::mutex> lock(q.lock);
+	if (q.jobs.empty()) {
+		return false;
+	}
+	job = q.jobs.back();
+	q.jobs.pop_back();
+	m_queued--;
+	return true;
+}
+
+/// Oldest job of the first other queue that has one
+bool TJobSystem::steal(int queue, TJob& job) {
+	const int count = int(m_queues.size());
+	for (int i = 1; i < count; i++) {
+		TJobQueue& q = m_queues[(queue + i) % count];
+		std::lock_guard<std::mutex> lock(q.lock);
+		if (!q.jobs.empty()) {
+			job = q.jobs.front();
+			q.jobs.pop_front();
+			m_queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+/// Claims invocations of the job's task until there are none left, so a
+/// job stolen late only finds what the others haven't started
+void TJobSystem::execute(const TJob& job) {
+	TTaskGraph& graph = *job.graph;
+	TTaskGraph::TTask& task = graph.m_tasks[job.task];
+
+	int done = 0;
+	for (int i = task.next++; i < task.count; i = task.next++) {
+		task.fn(i);
+		done++;
+	}
+
+	if (done > 0 && task.remaining.fetch_sub(done) == done) {
+		finish(graph, job.task);
+	}
+
+	/// Last access to the graph, run() may return and destroy it after this
+	if (graph.m_jobs.fetch_sub(1) == 1) {
+		wake();
+	}
+}
+
+/// Queues jobs for a task whose dependencies are done, one per thread at
+/// most since every job runs invocations until the task is drained
+void TJobSystem::release(TTaskGraph& graph, int task) {
+	TTaskGraph::TTask& t = graph.m_tasks[task];
+	t.next = 0;
+	t.remaining = t.count;
+	if (t.count <= 0) {
+		finish(graph, task);
+		return;
+	}
+
+	const int jobs = std::min(t.count, threads());
+	graph.m_jobs += jobs;
+
+	TJobQueue& q = m_queues[currentQueue()];
+	{
+		std::lock_guard<std::mutex> lock(q.lock);
+		for (int i = 0; i < jobs; i++) {
+			q.jobs.push_back({ &graph, task });
+		}
+		m_queued += jobs;
+	}
+	wake();
+}
+
+void TJobSystem::finish(TTaskGraph& graph, int task) {
+	for (int dependent : graph.m_tasks[task].dependents) {
+		if (graph.m_tasks[dependent].pending.fetch_sub(1) == 1) {
+			release(graph, dependent);
+		}
+	}
+
+	/// Dependents are queued first, the graph is never seen done early
+	graph.m_unfinished--;
+}
+
+void TJobSystem::wake() {
+	{
+		std::lock_guard<std::mutex> lock(m_sleepLock);
+	}
+	m_sleepSignal.notify_all();
+}
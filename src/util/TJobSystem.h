@@ -0,0 +1,109 @@
+#ifndef T_JOB_SYSTEM_H
+#define T_JOB_SYSTEM_H
+
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class TJobSystem;
+
+/// Tasks and the order between them. A task runs its function once per index
+/// in [0, count), the invocations are spread over the threads and may run in
+/// any order. A task starts once every task it comes after has finished.
+class TTaskGraph {
+	friend class TJobSystem;
+public:
+	using TTaskFunc = std::function<void(int)>;
+
+	/// Returns the ID of the new task
+	int add(TTaskFunc fn, int count = 1);
+
+	/// 'task' starts after 'dependency' finished
+	void after(int task, int dependency);
+
+	/// Changes the invocation count of a task that hasn't started yet, e.g.
+	/// from one of its dependencies that found out how much work it has
+	void count(int task, int count) { m_tasks[task].count = count; }
+
+	int size() const { return int(m_tasks.size()); }
+
+private:
+	struct TTask {
+		TTaskFunc fn;
+		int count;
+		std::vector<int> dependents;
+		int dependencies;
+
+		std::atomic<int> pending; // Dependencies left
+		std::atomic<int> next; // Next invocation to claim
+		std::atomic<int> remaining; // Invocations left
+	};
+
+	/// A deque, so the tasks stay in place while the graph grows
+	std::deque<TTask> m_tasks;
+	std::atomic<int> m_unfinished;
+
+	/// Queued or running jobs, the graph is in use until they're all gone
+	std::atomic<int> m_jobs;
+};
+
+/// Persistent worker threads, each with its own deque of jobs. A job runs
+/// invocations of a task; workers take the newest job of their own deque
+/// first and steal the oldest one of another deque when theirs is empty.
+/// The thread calling run() works with them until the graph is done.
+class TJobSystem {
+public:
+	/// 'threads' counts the calling thread, so there are threads - 1 workers.
+	/// 0 uses one thread per hardware thread. Worker i is pinned to
+	/// cpus[i % cpus.size()] when 'cpus' isn't empty (only on Linux).
+	TJobSystem(int threads, const std::vector<int>& cpus = {});
+	virtual ~TJobSystem();
+
+	int threads() const { return int(m_workers.size()) + 1; }
+
+	/// Runs every task of the graph, returns once they're all done. Can be
+	/// called from inside a task.
+	void run(TTaskGraph& graph);
+
+	/// Calls fn(i) for every i in [0, count) and waits for them
+	void parallelFor(int count, const TTaskGraph::TTaskFunc& fn);
+
+private:
+	struct TJob {
+		TTaskGraph* graph;
+		int task;
+	};
+
+	struct alignas(64) TJobQueue {
+		std::mutex lock;
+		std::deque<TJob> jobs;
+	};
+
+	std::vector<std::thread> m_workers;
+
+	/// One queue per worker, plus queue 0 for the thread calling run()
+	std::vector<TJobQueue> m_queues;
+
+	/// Jobs in the queues, idle threads sleep while it's 0
+	std::atomic<int> m_queued;
+	std::mutex m_sleepLock;
+	std::condition_variable m_sleepSignal;
+	bool m_quit;
+
+	void workerLoop(int queue);
+	int currentQueue() const;
+
+	bool pop(int queue, TJob& job);
+	bool steal(int queue, TJob& job);
+	void execute(const TJob& job);
+
+	void release(TTaskGraph& graph, int task);
+	void finish(TTaskGraph& graph, int task);
+	void wake();
+};
+
+#endif // T_JOB_SYSTEM_H
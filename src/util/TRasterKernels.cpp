@@ -0,0 +1,240 @@
+#include "TRasterKernels.h"
+
+#include "common.hpp"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define T_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define T_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define T_TARGET_AVX2
+#endif
+
+static const float T_ONE_THIRD = 1.0f / 3.0f;
+
+/// 'Covered' kernels are for rows known to be inside the triangle, they
+/// skip the coverage test and only interpolate and test depth
+template <bool Covered>
+static uint64_t rowKernelScalar(const TRowSpan& span, const float* depth, int count, float* outZ) {
+	uint64_t mask = 0;
+	int32_t e0 = span.edge[0], e1 = span.edge[1], e2 = span.edge[2];
+	for (int i = 0; i < count; i++) {
+		if (Covered || (e0 | e1 | e2) >= 0) {
+			float z = glm::dot(tSpanWeights(span, i), span.invW) * T_ONE_THIRD;
+			outZ[i] = z;
+			if (depth[i] < z) {
+				mask |= uint64_t(1) << i;
+			}
+		}
+		e0 += span.edgeStep[0];
+		e1 += span.edgeStep[1];
+		e2 += span.edgeStep[2];
+	}
+	return mask;
+}
+
+#ifdef T_X86
+template <bool Covered>
+static uint64_t rowKernelSSE(const TRowSpan& span, const float* depth, int count, float* outZ) {
+	const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	const __m128 iw0 = _mm_set1_ps(span.invW.x);
+	const __m128 iw1 = _mm_set1_ps(span.invW.y);
+	const __m128 iw2 = _mm_set1_ps(span.invW.z);
+	const __m128 third = _mm_set1_ps(T_ONE_THIRD);
+
+	/// Edge functions of the 4 lanes, stepped by 4 pixels
+	__m128i e0 = _mm_setr_epi32(span.edge[0], span.edge[0] + span.edgeStep[0], span.edge[0] + span.edgeStep[0] * 2, span.edge[0] + span.edgeStep[0] * 3);
+	__m128i e1 = _mm_setr_epi32(span.edge[1], span.edge[1] + span.edgeStep[1], span.edge[1] + span.edgeStep[1] * 2, span.edge[1] + span.edgeStep[1] * 3);
+	__m128i e2 = _mm_setr_epi32(span.edge[2], span.edge[2] + span.edgeStep[2], span.edge[2] + span.edgeStep[2] * 2, span.edge[2] + span.edgeStep[2] * 3);
+	const __m128i s0 = _mm_set1_epi32(span.edgeStep[0] * 4);
+	const __m128i s1 = _mm_set1_epi32(span.edgeStep[1] * 4);
+	const __m128i s2 = _mm_set1_epi32(span.edgeStep[2] * 4);
+
+	uint64_t mask = 0;
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		/// The 4 lanes are in one block, stepped from its start
+		const int x = span.x + i;
+		const glm::vec3 block = span.bc + span.step * float(x & ~(T_ROW_BLOCK - 1));
+		const __m128 fi = _mm_add_ps(_mm_set1_ps(float(x & (T_ROW_BLOCK - 1))), lane);
+		__m128 b0 = _mm_add_ps(_mm_set1_ps(block.x), _mm_mul_ps(fi, _mm_set1_ps(span.step.x)));
+		__m128 b1 = _mm_add_ps(_mm_set1_ps(block.y), _mm_mul_ps(fi, _mm_set1_ps(span.step.y)));
+		__m128 b2 = _mm_add_ps(_mm_set1_ps(block.z), _mm_mul_ps(fi, _mm_set1_ps(span.step.z)));
+
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b0, iw0), _mm_mul_ps(b1, iw1)), _mm_mul_ps(b2, iw2));
+		__m128 z = _mm_mul_ps(d, third);
+		_mm_storeu_ps(outZ + i, z);
+
+		__m128 pass = _mm_cmplt_ps(_mm_loadu_ps(depth + i), z);
+		if (!Covered) {
+			/// Covered lanes have no sign bit set in any edge function
+			__m128i outside = _mm_srai_epi32(_mm_or_si128(_mm_or_si128(e0, e1), e2), 31);
+			pass = _mm_andnot_ps(_mm_castsi128_ps(outside), pass);
+			e0 = _mm_add_epi32(e0, s0);
+			e1 = _mm_add_epi32(e1, s1);
+			e2 = _mm_add_epi32(e2, s2);
+		}
+		mask |= uint64_t(_mm_movemask_ps(pass)) << i;
+	}
+
+	if (i < count) {
+		TRowSpan tail = span;
+		tail.x += i;
+		for (int k = 0; k < 3; k++) {
+			tail.edge[k] += span.edgeStep[k] * i;
+		}
+		mask |= rowKernelScalar<Covered>(tail, depth + i, count - i, outZ + i) << i;
+	}
+	return mask;
+}
+
+template <bool Covered>
+T_TARGET_AVX2
+static uint64_t rowKernelAVX2(const TRowSpan& span, const float* depth, int count, float* outZ) {
+	/// A vector is one block, spans starting inside one take the SSE path
+	if ((span.x & (T_ROW_BLOCK - 1)) != 0) {
+		return rowKernelSSE<Covered>(span, depth, count, outZ);
+	}
+
+	const __m256 lane = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+	const __m256 iw0 = _mm256_set1_ps(span.invW.x);
+	const __m256 iw1 = _mm256_set1_ps(span.invW.y);
+	const __m256 iw2 = _mm256_set1_ps(span.invW.z);
+	const __m256 third = _mm256_set1_ps(T_ONE_THIRD);
+
+	/// Edge functions of the 8 lanes, stepped by 8 pixels
+	const __m256i lanei = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i e0 = _mm256_add_epi32(_mm256_set1_epi32(span.edge[0]), _mm256_mullo_epi32(lanei, _mm256_set1_epi32(span.edgeStep[0])));
+	__m256i e1 = _mm256_add_epi32(_mm256_set1_epi32(span.edge[1]), _mm256_mullo_epi32(lanei, _mm256_set1_epi32(span.edgeStep[1])));
+	__m256i e2 = _mm256_add_epi32(_mm256_set1_epi32(span.edge[2]), _mm256_mullo_epi32(lanei, _mm256_set1_epi32(span.edgeStep[2])));
+	const __m256i s0 = _mm256_set1_epi32(span.edgeStep[0] * 8);
+	const __m256i s1 = _mm256_set1_epi32(span.edgeStep[1] * 8);
+	const __m256i s2 = _mm256_set1_epi32(span.edgeStep[2] * 8);
+
+	uint64_t mask = 0;
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		/// The 8 lanes are one block, stepped from its start
+		const glm::vec3 block = span.bc + span.step * float(span.x + i);
+		__m256 b0 = _mm256_add_ps(_mm256_set1_ps(block.x), _mm256_mul_ps(lane, _mm256_set1_ps(span.step.x)));
+		__m256 b1 = _mm256_add_ps(_mm256_set1_ps(block.y), _mm256_mul_ps(lane, _mm256_set1_ps(span.step.y)));
+		__m256 b2 = _mm256_add_ps(_mm256_set1_ps(block.z), _mm256_mul_ps(lane, _mm256_set1_ps(span.step.z)));
+
+		__m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(b0, iw0), _mm256_mul_ps(b1, iw1)), _mm256_mul_ps(b2, iw2));
+		__m256 z = _mm256_mul_ps(d, third);
+		_mm256_storeu_ps(outZ + i, z);
+
+		__m256 pass = _mm256_cmp_ps(_mm256_loadu_ps(depth + i), z, _CMP_LT_OQ);
+		if (!Covered) {
+			__m256i outside = _mm256_srai_epi32(_mm256_or_si256(_mm256_or_si256(e0, e1), e2), 31);
+			pass = _mm256_andnot_ps(_mm256_castsi256_ps(outside), pass);
+			e0 = _mm256_add_epi32(e0, s0);
+			e1 = _mm256_add_epi32(e1, s1);
+			e2 = _mm256_add_epi32(e2, s2);
+		}
+		mask |= uint64_t(_mm256_movemask_ps(pass)) << i;
+	}
+
+	if (i < count) {
+		TRowSpan tail = span;
+		tail.x += i;
+		for (int k = 0; k < 3; k++) {
+			tail.edge[k] += span.edgeStep[k] * i;
+		}
+		mask |= rowKernelSSE<Covered>(tail, depth + i, count - i, outZ + i) << i;
+	}
+	return mask;
+}
+#endif
+
+static void packRow8Scalar(const glm::vec4* src, uint8_t* dst, int count, TPixelOrder order) {
+	const int r = order == TPixelOrder::RGBA ? 0 : 2;
+	const int b = 2 - r;
+	for (int i = 0; i < count; i++) {
+		glm::vec4 col = glm::clamp(src[i], 0.0f, 1.0f) * 255.0f + 0.5f;
+		dst[i * 4 + r] = uint8_t(col.r);
+		dst[i * 4 + 1] = uint8_t(col.g);
+		dst[i * 4 + b] = uint8_t(col.b);
+		dst[i * 4 + 3] = uint8_t(col.a);
+	}
+}
+
+void packRow8(const glm::vec4* src, uint8_t* dst, int count, TPixelOrder order) {
+	int i = 0;
+#ifdef T_X86
+	/// SSE2 is part of the baseline build flags, no dispatch needed
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(255.0f);
+	const float* in = reinterpret_cast<const float*>(src);
+
+	auto convert = [&](int k) {
+		__m128 c = _mm_loadu_ps(in + k * 4);
+		c = _mm_mul_ps(_mm_min_ps(_mm_max_ps(c, zero), one), scale);
+		__m128i v = _mm_cvtps_epi32(c);
+		if (order == TPixelOrder::BGRA) {
+			v = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 0, 1, 2));
+		}
+		return v;
+	};
+
+	for (; i + 4 <= count; i += 4) {
+		__m128i lo = _mm_packs_epi32(convert(i), convert(i + 1));
+		__m128i hi = _mm_packs_epi32(convert(i + 2), convert(i + 3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	packRow8Scalar(src + i, dst + i * 4, count - i, order);
+}
+
+TSimdLevel detectSimdLevel() {
+#if defined(T_X86) && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return TSimdLevel::AVX2;
+	if (__builtin_cpu_supports("sse2")) return TSimdLevel::SSE;
+#elif defined(T_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	const int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	const bool sse2 = (info[3] & (1 << 26)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+
+	if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+		__cpuidex(info, 7, 0);
+		if (info[1] & (1 << 5)) return TSimdLevel::AVX2;
+	}
+	if (sse2) return TSimdLevel::SSE;
+#endif
+	return TSimdLevel::Scalar;
+}
+
+TRowKernel rowKernel(TSimdLevel level) {
+#ifdef T_X86
+	switch (level) {
+		case TSimdLevel::AVX2: return rowKernelAVX2<false>;
+		case TSimdLevel::SSE: return rowKernelSSE<false>;
+		default: break;
+	}
+#endif
+	return rowKernelScalar<false>;
+}
+
+TRowKernel coveredRowKernel(TSimdLevel level) {
+#ifdef T_X86
+	switch (level) {
+		case TSimdLevel::AVX2: return rowKernelAVX2<true>;
+		case TSimdLevel::SSE: return rowKernelSSE<true>;
+		default: break;
+	}
+#endif
+	return rowKernelScalar<true>;
+}
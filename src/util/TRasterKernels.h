@@ -0,0 +1,65 @@
+#ifndef T_RASTER_KERNELS_H
+#define T_RASTER_KERNELS_H
+
+#include <cstdint>
+
+#include "vec3.hpp"
+#include "vec4.hpp"
+#include "geometric.hpp"
+
+/// Byte order of 8-bit packed pixels. BGRA is SDL's ARGB8888 on little endian.
+enum class TPixelOrder {
+	RGBA,
+	BGRA
+};
+
+enum class TSimdLevel {
+	Scalar = 0,
+	SSE,
+	AVX2
+};
+
+/// Row kernels step the barycentric weights from the start of the aligned
+/// block of T_ROW_BLOCK pixels holding each pixel, never from the start of
+/// the span, so a pixel gets the same depth whatever span (and tile size)
+/// it's drawn with
+#define T_ROW_BLOCK 8
+
+/// Input of a row kernel: the fixed-point edge functions at the first pixel
+/// of the row and their per-pixel increment, which decide coverage, then the
+/// screen x of the first pixel (a multiple of 4), the barycentric weights at
+/// x = 0 of the row, their increment and the reciprocal vertex W's, which
+/// give the depth. The edge functions must not overflow over the row.
+struct TRowSpan {
+	int32_t edge[3];
+	int32_t edgeStep[3];
+	int x;
+	glm::vec3 bc;
+	glm::vec3 step;
+	glm::vec3 invW;
+};
+
+/// Barycentric weights of pixel i of the span, as the kernels compute them
+inline glm::vec3 tSpanWeights(const TRowSpan& span, int i) {
+	const int x = span.x + i;
+	const glm::vec3 block = span.bc + span.step * float(x & ~(T_ROW_BLOCK - 1));
+	return block + span.step * float(x & (T_ROW_BLOCK - 1));
+}
+
+/// Tests coverage, interpolates depth and runs the depth test for 'count'
+/// (<= 64) consecutive pixels. Writes the interpolated depth to 'outZ' and
+/// returns a mask with bit i set if pixel i is covered and passes the test.
+/// A pixel is covered when none of its edge functions is negative.
+typedef uint64_t (*TRowKernel)(const TRowSpan& span, const float* depth, int count, float* outZ);
+
+/// Clamps 'count' float colors to [0, 1] and packs them to 4 bytes each
+void packRow8(const glm::vec4* src, uint8_t* dst, int count, TPixelOrder order);
+
+TSimdLevel detectSimdLevel();
+TRowKernel rowKernel(TSimdLevel level);
+
+/// Same as rowKernel() for pixels known to be covered: only depth is
+/// interpolated and tested, the edge functions are ignored
+TRowKernel coveredRowKernel(TSimdLevel level);
+
+#endif // T_RASTER_KERNELS_H
@@ -0,0 +1,163 @@
+#include "TWindow.h"
+
+#include <iostream>
+
+#include "TRasterKernels.h"
+
+static void showError() {
+	std::cerr << SDL_GetError() << std::endl;
+}
+
+TWindow* TWindow::create(const std::string& title, int width, int height, int drawWidth, int drawHeight) {
+	SDL_Init(SDL_INIT_VIDEO);
+
+	TWindow* win = new TWindow();
+	win->m_width = width;
+	win->m_height = height;
+	win->m_drawWidth = drawWidth;
+	win->m_drawHeight = drawHeight;
+	win->m_renderer = nullptr;
+	win->m_screenBuffer = nullptr;
+	win->m_lockedPixels = nullptr;
+	win->m_lockedPitch = 0;
+	win->m_pending = nullptr;
+	win->m_quit = false;
+
+	win->m_window = SDL_CreateWindow(
+		title.c_str(),
+		SDL_WINDOWPOS_CENTERED,
+		SDL_WINDOWPOS_CENTERED,
+		width, height,
+		SDL_WINDOW_SHOWN
+	);
+	if (win->m_window == nullptr) {
+		showError();
+		delete win;
+		return nullptr;
+	}
+
+	win->m_renderer = SDL_CreateRenderer(win->m_window, 0, SDL_RENDERER_ACCELERATED);
+	if (win->m_renderer == nullptr) {
+		showError();
+		delete win;
+		return nullptr;
+	}
+
+	win->m_screenBuffer = SDL_CreateTexture(
+		win->m_renderer,
+		SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING,
+		drawWidth, drawHeight
+	);
+
+	return win;
+}
+
+TWindow::~TWindow() {
+	if (m_presentThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lk(m_presentLock);
+			m_quit = true;
+		}
+		m_presentSignal.notify_all();
+		m_presentThread.join();
+	}
+	if (m_lockedPixels) SDL_UnlockTexture(m_screenBuffer);
+	if (m_screenBuffer) SDL_DestroyTexture(m_screenBuffer);
+	if (m_renderer) SDL_DestroyRenderer(m_renderer);
+	if (m_window) SDL_DestroyWindow(m_window);
+}
+
+bool TWindow::poll() {
+	bool open = true;
+	while (SDL_PollEvent(&m_event)) {
+		if (m_event.type == SDL_QUIT) open = false;
+	}
+	return open;
+}
+
+void TWindow::present(TTexture* color, TJobSystem& jobs) {
+	finish();
+
+	/// Flip screen
+	Uint8* pixels;
+	int pitch;
+	SDL_LockTexture(m_screenBuffer, nullptr, (void**) &pixels, &pitch);
+
+	/// Only a Tiled target needs the scratch row
+	const int scratchSize = color->layout() == TTextureLayout::Tiled ? m_drawWidth : 0;
+
+	jobs.parallelFor(m_drawHeight, [&](int y) {
+		std::vector<glm::vec4> scratch(scratchSize);
+		packRow8(color->row(y, scratch.data()), pixels + y * pitch, m_drawWidth, TPixelOrder::BGRA);
+	});
+
+	m_lockedPixels = pixels;
+	m_lockedPitch = pitch;
+	show();
+}
+
+void TWindow::presentAsync(TTexture* color) {
+	finish();
+
+	if (!m_presentThread.joinable()) {
+		m_presentThread = std::thread(&TWindow::presentLoop, this);
+	}
+
+	SDL_LockTexture(m_screenBuffer, nullptr, (void**) &m_lockedPixels, &m_lockedPitch);
+	{
+		std::lock_guard<std::mutex> lk(m_presentLock);
+		m_pending = color;
+	}
+	m_presentSignal.notify_all();
+}
+
+void TWindow::finish() {
+	waitIdle();
+	if (m_lockedPixels) {
+		show();
+	}
+}
+
+void TWindow::waitIdle() {
+	std::unique_lock<std::mutex> lk(m_presentLock);
+	m_presentSignal.wait(lk, [this]() { return m_pending == nullptr; });
+}
+
+void TWindow::show() {
+	SDL_UnlockTexture(m_screenBuffer);
+	m_lockedPixels = nullptr;
+
+	SDL_RenderClear(m_renderer);
+
+	SDL_Rect rec = { 0, 0, m_width, m_height };
+	SDL_RenderCopy(m_renderer, m_screenBuffer, nullptr, &rec);
+
+	SDL_RenderPresent(m_renderer);
+}
+
+void TWindow::presentLoop() {
+	while (true) {
+		TTexture* color;
+		{
+			std::unique_lock<std::mutex> lk(m_presentLock);
+			m_presentSignal.wait(lk, [this]() { return m_pending != nullptr || m_quit; });
+			if (m_quit) {
+				break;
+			}
+			color = m_pending;
+		}
+
+		/// Serial on purpose, the job system is busy with the next frame
+		std::vector<glm::vec4> scratch(m_drawWidth);
+		for (int y = 0; y < m_drawHeight; y++) {
+			packRow8(color->row(y, scratch.data()), m_lockedPixels + y * m_lockedPitch, m_drawWidth, TPixelOrder::BGRA);
+		}
+
+		{
+			std::lock_guard<std::mutex> lk(m_presentLock);
+			m_pending = nullptr;
+		}
+		m_presentSignal.notify_all();
+	}
+}
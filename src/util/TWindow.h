@@ -0,0 +1,68 @@
+#ifndef T_WINDOW_H
+#define T_WINDOW_H
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "SDL2/SDL.h"
+
+#include "../data/TTexture.h"
+#include "TJobSystem.h"
+
+/// SDL presentation backend, optional: a headless GFX never creates one
+/// and never initializes SDL.
+class TWindow {
+public:
+	/// Returns nullptr (and prints the SDL error) if the window can't be created
+	static TWindow* create(const std::string& title, int width, int height, int drawWidth, int drawHeight);
+	virtual ~TWindow();
+
+	/// Returns false once the window was asked to close
+	bool poll();
+
+	/// Converts 'color' (an RGBA32F render target of the draw size, in either layout)
+	/// to the screen format on the threads of 'jobs' and shows it
+	void present(TTexture* color, TJobSystem& jobs);
+
+	/// Pipelined present: shows the frame queued by the previous call, then
+	/// hands 'color' to the present thread and returns right away. 'color'
+	/// must not be written until the next presentAsync() or finish().
+	void presentAsync(TTexture* color);
+
+	/// Waits for the queued frame, if any, and shows it
+	void finish();
+
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+
+private:
+	TWindow() {}
+
+	void presentLoop();
+	void waitIdle();
+	void show();
+
+	int m_width, m_height,
+		m_drawWidth, m_drawHeight;
+
+	SDL_Event m_event;
+	SDL_Window* m_window;
+	SDL_Renderer* m_renderer;
+	SDL_Texture* m_screenBuffer;
+
+	/// Screen texture memory while it's locked for the present thread
+	Uint8* m_lockedPixels;
+	int m_lockedPitch;
+
+	/// Present thread, started by the first presentAsync(). Only converts
+	/// into the locked texture, every SDL call stays on the caller's thread.
+	std::thread m_presentThread;
+	std::mutex m_presentLock;
+	std::condition_variable m_presentSignal;
+	TTexture* m_pending; // Frame being converted, nullptr when idle
+	bool m_quit;
+};
+
+#endif // T_WINDOW_H